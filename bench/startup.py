@@ -0,0 +1,199 @@
+#!/usr/bin/env python3
+"""
+Startup benchmark. Generates a synthetic database and measures the time from
+launching the AS until it answers its first UDP request.
+
+usage: python3 bench/startup.py [-e engine] [-u users] [-a auctions] [-b bids] [-d dir] [-k]
+
+With `-e fs` (the default) an ASDIR directory layout is generated. With `-e log`
+an ASDIR/DB.log with the same users, auctions and bids is generated instead, and
+the AS is timed twice: replaying the whole log, and loading the snapshot it
+writes once it has replayed more than DB_SNAPSHOT_INTERVAL records, e.g. for
+1M bids:
+
+    python3 bench/startup.py -e log -u 1000 -a 999 -b 1000
+
+The database is generated in `dir` (a temporary directory by default) and reused
+if it already exists, so the AS can be timed with a cold and a warm page cache.
+Auctions past 999 are stored as extended AIDs, so the AS is started with -x.
+"""
+import argparse
+import os
+import shutil
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+AS = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "AS")
+START = "2024-01-01 12:00:00"
+
+
+def auction_dir(root, aid):
+    if aid <= 999:
+        return os.path.join(root, "AUCTIONS", "%03d" % aid)
+    return os.path.join(root, "AUCTIONS", "X%03d" % (aid // 1000), "%06d" % aid)
+
+
+def write(path, data):
+    with open(path, "w") as f:
+        f.write(data)
+
+
+def generate(root, n_users, n_auctions, n_bids):
+    os.makedirs(os.path.join(root, "USERS"))
+    os.makedirs(os.path.join(root, "AUCTIONS"))
+    for u in range(n_users):
+        uid = "%06d" % (100000 + u)
+        path = os.path.join(root, "USERS", uid)
+        os.makedirs(os.path.join(path, "HOSTED"))
+        os.makedirs(os.path.join(path, "BIDDED"))
+        write(os.path.join(path, uid + "_pass.txt"), "abcdefgh")
+        if u % 2 == 0:
+            write(os.path.join(path, uid + "_login.txt"), "")
+
+    for aid in range(1, n_auctions + 1):
+        path = auction_dir(root, aid)
+        os.makedirs(os.path.join(path, "BIDS"))
+        os.makedirs(os.path.join(path, "ASSET"))
+        host = "%06d" % (100000 + aid % n_users)
+        write(os.path.join(path, "START_%03d.txt" % aid),
+              "%s asset%d asset.txt 10 3600 %s %d\n" % (host, aid % 1000, START, int(time.time())))
+        write(os.path.join(path, "ASSET", "asset.txt"), "x")
+        write(os.path.join(root, "USERS", host, "HOSTED", "%03d.txt" % aid), "")
+        for b in range(n_bids):
+            bidder = "%06d" % (100000 + (aid + b + 1) % n_users)
+            write(os.path.join(path, "BIDS", "%06d.txt" % (11 + b)), "%s %s %d\n" % (bidder, START, b))
+            write(os.path.join(root, "USERS", bidder, "BIDDED", "%03d.txt" % aid), "")
+
+
+# struct wal_record of server/wal.h, WAL_OPEN and WAL_BID of wal_record_t
+WAL_RECORD = struct.Struct("<QIiiii4xq7s9s11s25s4x")
+WAL_REGISTER, WAL_OPEN, WAL_BID = 1, 5, 6
+WAL_HASH_SEED = 2166136261
+
+
+def wal_hash(data):
+    h = WAL_HASH_SEED
+    for b in data:
+        h = ((h ^ b) * 16777619) & 0xffffffff
+    return h
+
+
+def generate_log(root, n_users, n_auctions, n_bids):
+    os.makedirs(root)
+    now = int(time.time())
+    lsn = 0
+    with open(os.path.join(root, "DB.log"), "wb") as log:
+        def append(kind, aid=0, value=0, time_active=0, uid=b"", passwd=b"", name=b"", fname=b""):
+            nonlocal lsn
+            lsn += 1
+            fields = [lsn, 0, kind, aid, value, time_active, now, uid, passwd, name, fname]
+            fields[1] = wal_hash(WAL_RECORD.pack(*fields))
+            log.write(WAL_RECORD.pack(*fields))
+
+        for u in range(n_users):
+            append(WAL_REGISTER, uid=b"%06d" % (100000 + u), passwd=b"abcdefgh")
+
+        for aid in range(1, n_auctions + 1):
+            host = b"%06d" % (100000 + aid % n_users)
+            append(WAL_OPEN, aid, 10, 99999, host, name=b"asset%d" % (aid % 1000), fname=b"asset.txt")
+            for b in range(n_bids):
+                append(WAL_BID, aid, 11 + b, uid=b"%06d" % (100000 + (aid + b + 1) % n_users))
+
+
+def start_as(workdir, port, engine, extended):
+    args = [AS, "-v", "-b", engine, "-p", str(port)] + (["-x"] if extended else [])
+    log = open(os.path.join(workdir, "as.log"), "w")
+    return subprocess.Popen(args, cwd=workdir, stdout=log, stderr=subprocess.STDOUT), log
+
+
+def time_to_ready(workdir, port, engine, extended):
+    start = time.monotonic()
+    proc, log = start_as(workdir, port, engine, extended)
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(0.05)
+    try:
+        while proc.poll() is None:
+            try:
+                sock.sendto(b"LST\n", ("127.0.0.1", port))
+                sock.recvfrom(65535)
+                return time.monotonic() - start
+            except OSError:
+                pass
+    finally:
+        proc.terminate()
+        proc.wait()
+        log.close()
+
+    sys.exit("AS exited before it was ready, see %s" % os.path.join(workdir, "as.log"))
+
+
+def write_snapshot(workdir, port, extended):
+    """Starts the AS on the log until it has written its snapshot and truncated the log"""
+    root = os.path.join(workdir, "ASDIR")
+    proc, log = start_as(workdir, port, "log", extended)
+    try:
+        while not (os.path.exists(os.path.join(root, "DB.snap")) and
+                   os.path.getsize(os.path.join(root, "DB.log")) == 0):
+            if proc.poll() is not None:
+                sys.exit("AS exited before writing a snapshot, see %s" % os.path.join(workdir, "as.log"))
+            time.sleep(0.1)
+    finally:
+        proc.terminate()
+        proc.wait()
+        log.close()
+
+
+def report(name, workdir, elapsed):
+    print("%s: time to ready %.0f ms" % (name, elapsed * 1000))
+    with open(os.path.join(workdir, "as.log")) as log:
+        for line in log:
+            if "phase" in line or "ready" in line or "Loaded" in line:
+                print("  " + line.strip())
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("-e", default="fs", choices=["fs", "log"], help="storage engine")
+    parser.add_argument("-u", type=int, default=20000, help="users")
+    parser.add_argument("-a", type=int, default=5000, help="auctions")
+    parser.add_argument("-b", type=int, default=40, help="bids per auction")
+    parser.add_argument("-d", help="directory of the generated ASDIR")
+    parser.add_argument("-k", action="store_true", help="keep the generated ASDIR")
+    args = parser.parse_args()
+
+    workdir = args.d or tempfile.mkdtemp()
+    root = os.path.join(workdir, "ASDIR")
+    if not os.path.exists(root):
+        print("generating %d users, %d auctions and %d bids in %s" % (args.u, args.a, args.a * args.b, root))
+        if args.e == "fs":
+            generate(root, args.u, args.a, args.b)
+        else:
+            generate_log(root, args.u, args.a, args.b)
+
+    port = 20000 + os.getpid() % 20000
+    extended = args.a > 999
+    if args.e == "fs":
+        report("fs", workdir, time_to_ready(workdir, port, "fs", extended))
+    else:
+        # the AS compacts the log once it's replayed, so it replays a copy
+        replay_dir = tempfile.mkdtemp()
+        shutil.copytree(root, os.path.join(replay_dir, "ASDIR"))
+        report("log replay", replay_dir, time_to_ready(replay_dir, port, "log", extended))
+        shutil.rmtree(replay_dir)
+
+        if not os.path.exists(os.path.join(root, "DB.snap")):
+            write_snapshot(workdir, port + 1, extended)
+
+        report("snapshot", workdir, time_to_ready(workdir, port + 2, "log", extended))
+
+    if not args.k and not args.d:
+        shutil.rmtree(workdir)
+
+
+if __name__ == "__main__":
+    main()
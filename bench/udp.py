@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+"""
+UDP throughput benchmark. Starts an AS with an empty database, opens `auctions`
+auctions and keeps `clients` processes sending UDP requests for `seconds`, each
+one with up to `window` requests waiting for their reply. Reports the requests
+answered per second and the latency percentiles, and the CPU cycles the AS
+spent on each request, as logged on SIGUSR1.
+
+usage: python3 bench/udp.py [-c clients] [-w window] [-t seconds] [-r requests] [-n auctions] [-e engine] [--as path]
+
+`requests` is a comma separated mix of LIN, LMA, LST and SRC (all of them by
+default). `--as` benchmarks another build of the AS, to compare two versions.
+More than 999 auctions start the AS with extended AIDs (-x). How LST latency
+scales with the number of auctions is measured with, e.g.:
+
+    for n in 10 100 1000 10000; do python3 bench/udp.py -c 1 -r LST -n $n; done
+"""
+import argparse
+import collections
+import multiprocessing
+import os
+import shutil
+import signal
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+AS = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "AS")
+AUCTIONS = 20  # opened by default
+
+
+def tcp_request(port, msg):
+    sock = socket.create_connection(("127.0.0.1", port), timeout=5)
+    sock.sendall(msg)
+    reply = b""
+    while True:
+        data = sock.recv(65536)
+        if not data:
+            break
+        reply += data
+    sock.close()
+    return reply
+
+
+def seed(port, auctions):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(0.2)
+    for _ in range(100):
+        try:
+            sock.sendto(b"LIN 100000 password\n", ("127.0.0.1", port))
+            sock.recvfrom(65535)
+            break
+        except OSError:
+            pass
+    else:
+        sys.exit("AS didn't answer")
+
+    for i in range(auctions):
+        tcp_request(port, b"OPA 100000 password item%d 10 3600 a.txt 1 x\n" % i)
+
+
+def requests(kinds, n, auctions):
+    msgs = []
+    for i in range(n):
+        kind = kinds[i % len(kinds)]
+        uid = b"%06d" % (100000 + i % 1000)
+        if kind == "LIN":
+            msgs.append(b"LIN " + uid + b" password\n")
+        elif kind == "LMA":
+            msgs.append(b"LMA 100000\n")
+        elif kind == "LST":
+            msgs.append(b"LST\n")
+        elif kind == "SRC":
+            msgs.append(b"SRC %03d\n" % (1 + i % auctions))
+    return msgs
+
+
+def client(port, kinds, auctions, window, seconds, queue):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(1)
+    msgs = requests(kinds, 1000, auctions)
+    latencies = []
+    lost = 0
+    end = time.monotonic() + seconds
+    i = 0
+    # replies to a client come back in order, they are all served by the same AS thread
+    waiting = collections.deque()
+    while time.monotonic() < end:
+        while len(waiting) < window:
+            waiting.append(time.monotonic())
+            sock.sendto(msgs[i % len(msgs)], ("127.0.0.1", port))
+            i += 1
+        try:
+            sock.recvfrom(65535)
+            latencies.append(time.monotonic() - waiting.popleft())
+        except socket.timeout:
+            lost += len(waiting)
+            waiting.clear()
+    queue.put((latencies, lost))
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("-c", type=int, default=8, help="client processes")
+    parser.add_argument("-w", type=int, default=1, help="requests each client keeps waiting for a reply")
+    parser.add_argument("-t", type=float, default=5, help="seconds")
+    parser.add_argument("-r", default="LIN,LMA,LST,SRC", help="requests mix")
+    parser.add_argument("-n", type=int, default=AUCTIONS, help="auctions opened before the clients start")
+    parser.add_argument("-e", default="mem", help="storage engine")
+    parser.add_argument("--as", dest="as_path", default=AS, help="AS binary")
+    args = parser.parse_args()
+
+    workdir = tempfile.mkdtemp()
+    port = 20000 + os.getpid() % 20000
+    log = open(os.path.join(workdir, "as.log"), "w")
+    extended = ["-x"] if args.n > 999 else []
+    proc = subprocess.Popen([os.path.abspath(args.as_path), "-b", args.e, "-p", str(port)] + extended,
+                            cwd=workdir, stdout=log, stderr=subprocess.STDOUT)
+    try:
+        seed(port, args.n)
+        queue = multiprocessing.Queue()
+        kinds = args.r.split(",")
+        clients = [multiprocessing.Process(target=client, args=(port, kinds, args.n, args.w, args.t, queue))
+                   for _ in range(args.c)]
+        for c in clients:
+            c.start()
+
+        latencies, lost = [], 0
+        for _ in clients:
+            l, n = queue.get()
+            latencies += l
+            lost += n
+        for c in clients:
+            c.join()
+
+        proc.send_signal(signal.SIGUSR1)
+        time.sleep(0.2)
+    finally:
+        proc.terminate()
+        proc.wait()
+        log.close()
+        with open(os.path.join(workdir, "as.log")) as f:
+            cost = [line.split("]: ", 1)[1].strip() for line in f if "requests served" in line]
+        shutil.rmtree(workdir)
+
+    latencies.sort()
+    n = len(latencies)
+    if n == 0:
+        sys.exit("no request was answered")
+
+    print("%d auctions, %d clients, window %d, %s: %.0f requests/s, p50 %.3f ms, p99 %.3f ms, %d lost" % (
+        args.n, args.c, args.w, args.r, n / args.t, latencies[n // 2] * 1000, latencies[n * 99 // 100] * 1000, lost))
+    if cost:
+        print(cost[-1])
+
+
+if __name__ == "__main__":
+    main()
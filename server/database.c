@@ -6,12 +6,14 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdlib.h>
-#include <dirent.h>
 #include <time.h>
+#include <stdint.h>
 #include <sys/socket.h>
 
 #include <pthread.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/timerfd.h>
 
 #include "../utils/constants.h"
 #include "../utils/config.h"
@@ -20,22 +22,409 @@
 #include "../utils/utils.h"
 
 #include "database.h"
+#include "fs_store.h"
+#include "wal.h"
+#include "write_behind.h"
+#include "dir_scan.h"
 
 
 static const mode_t SERVER_MODE = S_IREAD | S_IWRITE | S_IEXEC;
 
+/**
+* Storage engines. The FS engine keeps the database in the ASDIR directory layout,
+* with a file per user, auction and bid, written behind the requests by a writer
+* thread (see write_behind.h). The log engine appends every change to
+* a write-ahead log (see wal.h) and keeps users and bids in memory, rebuilding
+* them by replaying the log when the server starts. The directory layout can be
+* exported from the log with export_database(). The memory engine doesn't persist
+* anything but the assets, in a directory of its own, every start is a fresh
+* database.
+*
+* Every change is described by a log record, which is persisted by the engine and
+* then applied to the in-memory state. Every engine keeps the auction table and
+* the users in memory, so the rest of the database doesn't depend on the engine.
+* The log engine also writes snapshots of the database (see checkpoint_database())
+* so it doesn't have to replay the whole log on startup.
+*/
+struct storage_engine {
+    char *name;
+    int (*load)();                          // rebuilds the in-memory state
+    int (*persist)(struct wal_record *rec); // persists a record before it is applied
+    int (*sync)(struct wal_record *rec);    // waits until a persisted record is durable
+    int keeps_bids;                         // keeps every bid in memory, for snapshots and exports
+    int checkpoints;                        // writes snapshots, see checkpoint_database()
+};
+
+int load_fs_state();
+int load_log_state();
+int load_mem_state();
+int export_record(struct wal_record *rec);
+int persist_mem_record(struct wal_record *rec);
+int sync_unlogged_record(struct wal_record *rec);
+
+static struct storage_engine engines[] = {
+    [DB_ENGINE_FS]  = { "fs",  load_fs_state,  write_behind_push,  sync_unlogged_record, 0, 0 },
+    [DB_ENGINE_LOG] = { "log", load_log_state, wal_append,         wal_sync,             1, 1 },
+    [DB_ENGINE_MEM] = { "mem", load_mem_state, persist_mem_record, sync_unlogged_record, 0, 0 },
+};
+
+static struct storage_engine *engine = &engines[DB_ENGINE_FS];
+static int exporting = 0; // write the directory layout while replaying the log
+static char mem_root[] = DB_MEM_ROOT; // assets of the memory engine
+
 static int auc_count = 0;
+
+/**
+* Version of the auctions list, incremented after an auction opens, is closed or
+* expires, so responses rendered from it can be cached until it changes
+*/
+static unsigned long db_version = 0;
 int load_db_state();
+long lap_ms(struct timespec *lap);
+long current_time();
+
+/**
+* The FS engine loads users and auctions with DB_LOAD_THREADS threads, each one
+* takes the next item of a job until there are none left
+*/
+struct load_job {
+    int n;                              // number of items
+    int next;                           // next item to load
+    int fd;                             // directory the items are in
+    int *items;
+};
+
+int run_load_job(struct load_job *job, void *(*load_fn)(void *));
+void *load_users_fn(void *job);
+void *load_auctions_fn(void *job);
+
+/**
+* In-memory auction table. It mirrors the START and END files of every auction,
+* and its last MAX_SHOWN_BIDS bids, so that status queries (LST, LMA, LMB, SRC)
+* don't have to touch the filesystem.
+* The table is rebuilt from the ASDIR layout or from the log when the database
+* is initialized and kept in sync by every operation that opens or ends auctions.
+*/
+struct bid {
+    char uid[UID_SIZE + 1];             // bidder UID
+    int value;
+    char datetime[20];                  // YYYY-MM-DD HH:MM:SS
+    long sec_time;                      // seconds since the auction start
+};
+
+/**
+* Last SRC response rendered for an auction, sent again while the auction doesn't
+* change. The hits and misses measure how often it is reused. The responses of
+* all the auctions take at most SRC_CACHE_MAX_BYTES, see cache_auction_record()
+*/
+struct record_cache {
+    char *response;                     // NULL until the first SRC
+    int len;
+    int size;                           // bytes allocated for the response
+    unsigned long version;              // version of the auction it was rendered from
+    unsigned long hits;
+    unsigned long misses;
+};
+
+static long src_cache_bytes = 0; // bytes allocated for cached SRC responses
+void drop_cached_auction_record(struct record_cache *cache);
+
+struct auction {
+    int loaded;                         // 0 if the START file couldn't be read
+    char uid[UID_SIZE + 1];             // host UID
+    char name[ASSET_NAME_LEN + 1];
+    char fname[FNAME_LEN + 1];
+    int start_value;
+    int time_active;
+    long start_time;                    // UNIX timestamp of the auction start
+    char start_datetime[20];            // YYYY-MM-DD HH:MM:SS
+
+    int ended;                          // 1 if an END file exists
+    char end_datetime[20];
+    long end_sec_time;                  // seconds the auction remained open
+
+    int top_bid;                        // highest bid value, 0 if there are no bids
+    char top_bidder[UID_SIZE + 1];
+
+    struct bid recent_bids[MAX_SHOWN_BIDS]; // ring of the last bids, which are the biggest
+    int n_placed;                       // bids placed, the last one is at (n_placed - 1) % MAX_SHOWN_BIDS
+
+    struct bid *bids;                   // bids by increasing value, only kept by the log engine
+    int n_bids;
+    int bids_size;                      // number of allocated bids
+
+    unsigned long version;              // incremented by every bid and by its end
+    struct record_cache src;
+};
+
+/**
+* The auction table is split in chunks of AUCTION_CHUNK_SIZE auctions, allocated
+* as AIDs are assigned, so it can grow to MAX_EXT_AUCTIONS without moving the
+* auctions already published. Extended AIDs, past MAX_AUCTIONS, are only assigned
+* after set_database_extended_aids()
+*/
+#define AUCTION_CHUNK_SIZE 1024
+
+static struct auction *auction_chunks[MAX_EXT_AUCTIONS / AUCTION_CHUNK_SIZE + 1]; // entry 0 of chunk 0 is not used
+static int max_auctions = MAX_AUCTIONS;
+struct auction *auction_entry(int aid);
+struct auction *alloc_auction_entry(int aid);
+int last_sharded_aid(int auctions_fd, char *shard);
+int load_auction(int aid);
+int load_auction_files(struct auction *auc, int aid, int auc_fd);
+int load_bids(struct auction *auc, int auc_fd);
+void push_recent_bid(struct auction *auc, struct bid *new_bid);
+struct auction *get_auction(char *aid);
+int get_auction_count();
+void format_datetime(time_t t, char *buff);
+
+/**
+* In-memory users, indexed by UID. Users are allocated the first time they
+* register and never freed. The FS engine loads them from the USERS directory,
+* every change is written through to the engine before it is applied.
+*
+* Every user indexes the auctions they host and bid on in sorted sets of AIDs,
+* which mirror their HOSTED and BIDDED directories and answer LMA and LMB
+*/
+struct aid_set {
+    int *aids;                          // by increasing AID
+    int n;
+    int size;                           // number of allocated AIDs
+};
+
+struct user {
+    char passwd[PASSWORD_SIZE + 1];
+
+    struct aid_set hosted;
+    struct aid_set bidded;
+};
+
+static struct user *users[MAX_USERS];
+struct user *get_user(char *uid);
+
+/**
+* Registered and logged in users, a bit per UID. Bits are changed with atomic
+* operations, holding the user's lock or while loading, and read without any
+* lock, so checking a user is a single load. A logged in user is always
+* registered: registering sets the registered bit first and unregistering clears
+* it last
+*/
+#define USER_BITS (8 * sizeof(unsigned long))
+
+static unsigned long registered_bits[MAX_USERS / USER_BITS + 1];
+static unsigned long logged_in_bits[MAX_USERS / USER_BITS + 1];
+int user_registered(long uid);
+int user_logged_in(long uid);
+void set_user_state(long uid, int registered, int logged_in);
+int load_users();
+int load_user(int users_fd, char *uid);
+int load_user_auctions(int user_fd, char *path, struct aid_set *set);
+int aid_set_add(struct aid_set *set, int aid);
+int write_aid_set(struct aid_set *set, char *buff, int size);
+
+void init_record(struct wal_record *rec, wal_record_t type, int aid, char *uid);
+int persist_record(struct wal_record *rec);
+int commit_record(struct wal_record *rec);
+int sync_record(struct wal_record *rec);
+int apply_record(struct wal_record *rec);
+int replay_record(struct wal_record *rec);
+
+/**
+* Snapshots of the log engine. A snapshot holds every user and auction and the
+* bids still needed to export it, up to the log record `lsn`:
+*
+*   header | users | auctions | bids of auction 1 | ... | AIDs of user 1 | ...
+*
+* Users are written without their sets of AIDs, which follow the bids: the AIDs
+* each user hosts, then the AIDs they bid on.
+*
+* Only the last MAX_SHOWN_BIDS bids of each auction, the ones shown by SRC, and the
+* best bid of every other bidder, so the auction is exported to their BIDDED
+* directory, are kept. The log is
+* truncated once the snapshot is written. On startup the snapshot is mapped into
+* memory and only the log records written after it are replayed.
+*
+* Changes are committed holding `state_lock` shared, snapshots are written
+* holding it exclusively so they see the state of a single LSN.
+*/
+struct snapshot_header {
+    char magic[8];                      // SNAPSHOT_MAGIC
+    unsigned long lsn;                  // last log record in the snapshot
+    long n_users;
+    long n_auctions;
+    long n_bids;
+    long n_user_aids;
+    unsigned int checksum;              // of everything after the header
+};
+
+struct snapshot_user {
+    long uid;
+    int registered;
+    int logged_in;
+    char passwd[PASSWORD_SIZE + 1];
+    int n_hosted;
+    int n_bidded;
+};
+
+static const char SNAPSHOT_MAGIC[8] = "ASSNAP6";
+
+static pthread_rwlock_t state_lock;
+static pthread_mutex_t checkpoint_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t checkpoint_cond = PTHREAD_COND_INITIALIZER;
+static long records_since_snapshot = 0; // log records written after the last snapshot
+
+static int bidder_marks[MAX_USERS];     // last auction pass that saw each bidder, see mark_kept_bids()
+static int marks_pass = 0;
+
+int load_snapshot(unsigned long *lsn);
+int write_snapshot(unsigned long lsn);
+int export_snapshot();
+
+/**
+* Min-heap of auctions ordered by their deadline (start time + time active).
+* Every auction is pushed once, when it is created or loaded, so expiring
+* auctions only touches the ones whose deadline has passed. Auctions closed
+* by their owner before the deadline are simply skipped when popped. The closer
+* thread sleeps on a timerfd armed for the earliest deadline and closes the
+* auctions as they expire, requests never close them.
+*/
+struct deadline {
+    long deadline;
+    int aid;
+};
+
+static struct deadline *expiry_heap = NULL;
+static int expiry_heap_size = 0;
+static int expiry_heap_capacity = 0;
+static int expiry_timer_fd = -1;
+int expiry_heap_reserve();
+int expiry_heap_push(long deadline, int aid);
+void expiry_heap_pop();
+void arm_expiry_timer();
+
+/**
+* Lock manager. Every resource belongs to a lock class:
+*
+* DB_LOCK_CATALOG  - AID assignment and auction creation ("create_auction")
+* DB_LOCK_EXPIRY   - the expiry heap
+* DB_LOCK_AUCTION  - an auction's END file and BIDS directory, hashed by AID
+* DB_LOCK_USER     - a user's files, HOSTED and BIDDED directories, hashed by UID
+*
+* Auctions and users are hashed into DB_LOCK_STRIPES mutexes each, so independent
+* users and auctions proceed in parallel.
+*
+* Lock ordering: operations that need more than one lock at a time acquire them
+* in the order CATALOG -> EXPIRY -> AUCTION -> USER (e.g. db_place_bid() locks the
+* auction and then the bidder, db_open_auction() locks the catalog and then the host)
+* and never hold two locks of the same class.
+*
+* The auction table is read without locks. Its entries are immutable after they
+* are published by storing the new auc_count, apart from the `ended` flag which
+* is written last, atomically, after the END information.
+*/
+typedef enum {
+    DB_LOCK_CATALOG,
+    DB_LOCK_EXPIRY,
+    DB_LOCK_AUCTION,
+    DB_LOCK_USER,
+    DB_LOCK_CLASSES,
+} db_lock_t;
+
+static pthread_mutex_t catalog_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t expiry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t auction_mutexes[DB_LOCK_STRIPES];
+static pthread_mutex_t user_mutexes[DB_LOCK_STRIPES];
+
+/**
+* Lock wait counters of each lock class
+*/
+struct lock_stats {
+    unsigned long acquired;   // times the lock was acquired
+    unsigned long contended;  // times the lock was already held by another thread
+    unsigned long wait_ns;    // total time spent waiting for contended locks
+};
+
+static struct lock_stats lock_stats[DB_LOCK_CLASSES];
+static const char *lock_class_names[] = { "catalog", "expiry", "auction", "user" };
+
+int lock_db_mutex(db_lock_t type, char *resource);
+int unlock_db_mutex(db_lock_t type, char *resource);
+
+/**
+* Selects the storage engine, must be called before init_database()
+*/
+void set_database_engine(db_engine_t type) {
+    engine = &engines[type];
+}
+
+/**
+* Lets the database assign AIDs up to MAX_EXT_AUCTIONS, of EXT_AID_SIZE digits.
+* Clients that only know AID_SIZE digits still reach the first MAX_AUCTIONS
+*/
+void set_database_extended_aids() {
+    max_auctions = MAX_EXT_AUCTIONS;
+}
+
+/**
+* Selects how the log engine syncs its records, must be called before
+* init_database(). Transactions are acknowledged once their record is durable
+*/
+void set_database_durability(db_durability_t level) {
+    switch (level) {
+        case DB_DURABILITY_NONE:   wal_set_durability(WAL_DURABILITY_NONE); break;
+        case DB_DURABILITY_GROUP:  wal_set_durability(WAL_DURABILITY_GROUP); break;
+        case DB_DURABILITY_STRICT: wal_set_durability(WAL_DURABILITY_STRICT); break;
+    }
+}
 
-static pthread_mutex_t db_mutex = PTHREAD_MUTEX_INITIALIZER;
-int lock_db_mutex(char *resource);
-int unlock_db_mutex(char *resource);
+/**
+* Get the most digits an AID can have
+*/
+int get_aid_size() {
+    return max_auctions > MAX_AUCTIONS ? EXT_AID_SIZE : AID_SIZE;
+}
 
 /**
 * Initializes DB. Returns 0 on success and -1 on fatal error.
 */
 int init_database() {
-    if (mkdir(DB_ROOT, SERVER_MODE) != 0) {
+    // snapshots must not wait behind a stream of commits
+    pthread_rwlockattr_t state_lock_attr;
+    pthread_rwlockattr_init(&state_lock_attr);
+    pthread_rwlockattr_setkind_np(&state_lock_attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    if (pthread_rwlock_init(&state_lock, &state_lock_attr) != 0) {
+        LOG_ERROR("[DB] Failed initializing database locks");
+        return -1;
+    }
+
+    pthread_rwlockattr_destroy(&state_lock_attr);
+
+    for (int i = 0; i < DB_LOCK_STRIPES; ++i) {
+        if (pthread_mutex_init(&auction_mutexes[i], NULL) != 0 ||
+            pthread_mutex_init(&user_mutexes[i], NULL) != 0) {
+            LOG_ERROR("[DB] Failed initializing database locks");
+            return -1;
+        }
+    }
+
+    if ((expiry_timer_fd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC)) < 0) {
+        LOG_ERROR("[DB] Failed creating the expiry timer");
+        LOG_ERROR("[DB] timerfd_create: %s", strerror(errno));
+        return -1;
+    }
+
+    char *root = DB_ROOT;
+    if (engine == &engines[DB_ENGINE_MEM]) {
+        // the memory engine keeps its assets away from ASDIR, so auctions without
+        // START files are never left there for the FS engine to load
+        if (mkdtemp(mem_root) == NULL) {
+            LOG_ERROR("[DB] Failed creating memory engine directory");
+            LOG_ERROR("[DB] mkdtemp: %s", strerror(errno));
+            return -1;
+        }
+
+        root = mem_root;
+    } else if (mkdir(DB_ROOT, SERVER_MODE) != 0) {
         if (errno != EEXIST) {
             LOG_ERROR("[DB] Failed creating database directory");
             LOG_ERROR("[DB] mkdir: %s", strerror(errno));
@@ -43,30 +432,23 @@ int init_database() {
         }
     }
 
-    if (chdir(DB_ROOT) != 0) {
+    if (chdir(root) != 0) {
         LOG_ERROR("[DB] chdir: %s", strerror(errno));
         return -1;
     }
 
-    // create USERS dir
-    if (mkdir("USERS", SERVER_MODE) != 0) {
-        if (errno != EEXIST) {
-            LOG_ERROR("[DB] Failed creating USERS directory in database");
-            LOG_ERROR("[DB] mkdir: %s", strerror(errno));
-            return -1;
-        }
+    // create USERS and AUCTIONS dirs, every engine keeps the auction assets in AUCTIONS
+    if (fs_store_init() != 0) {
+        return -1;
     }
 
-    // create AUCTIONS dir
-    if (mkdir("AUCTIONS", SERVER_MODE) != 0) {
-        if (errno != EEXIST) {
-            LOG_ERROR("[DB] Failed creating AUCTIONS directory");
-            LOG_ERROR("[DB] mkdir: %s", strerror(errno));
-            return -1;
-        }
+    // only the FS engine reads the auction table, the log engine writes it when exporting
+    if ((engine == &engines[DB_ENGINE_FS] || exporting) && fs_store_open_table(max_auctions) != 0) {
+        return -1;
     }
 
     // initialize DB state
+    LOG_VERBOSE("[DB] Using the %s storage engine", engine->name);
     if (load_db_state() != 0) {
         LOG_ERROR("[DB] Failed setting databse state");
         return -1;
@@ -75,1324 +457,2151 @@ int init_database() {
     return 0;
 }
 
+/**
+* Stops the database from taking changes and waits until every committed change
+* is written, or removes the assets of the memory engine, must be called before
+* the server exits. Requests changing the database block from then on, so none
+* is acknowledged without being written
+*/
+void close_database() {
+    // commits hold the state lock, and new auctions the catalog lock from the
+    // moment their asset is moved, so none is left half done
+    lock_db_mutex(DB_LOCK_CATALOG, "create_auction");
+    pthread_rwlock_wrlock(&state_lock);
+
+    if (engine == &engines[DB_ENGINE_FS]) {
+        write_behind_flush();
+        fs_store_sync();
+    } else if (engine == &engines[DB_ENGINE_MEM]) {
+        // the memory engine directory is in the directory the AS was started from
+        if (chdir("..") != 0 || remove_dir_tree(AT_FDCWD, mem_root) != 0) {
+            LOG_ERROR("[DB] Failed removing memory engine directory %s", mem_root);
+        }
+    }
+}
+
+/**
+* Writes the database kept in the log in the ASDIR directory layout, so it can be
+* served by the FS engine. Returns 0 on success and -1 on failure
+*/
+int export_database() {
+    engine = &engines[DB_ENGINE_LOG];
+    exporting = 1;
+
+    if (init_database() != 0) {
+        LOG_ERROR("[DB] Failed exporting database");
+        return -1;
+    }
+
+    wal_close();
+    fs_store_sync();
+
+    LOG("[DB] Exported %d auctions from %s/%s", auc_count, DB_ROOT, DB_LOG_FILE);
+    return 0;
+}
+
 int load_db_state() {
-    DIR *dp;
-    struct dirent *cur;
+    struct timespec start, lap;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    lap = start;
 
-    if ((dp = opendir("AUCTIONS")) == NULL) {
-        LOG_ERROR("[DB] Failed loading database state");
-        LOG_ERROR("[DB] open: %s", strerror(errno));
+    if (engine->load() != 0) {
         return -1;
     }
 
-    // count all auctions in DB
-    while ((cur = readdir(dp)) != NULL) {
-        if (cur->d_name[0] != '.') auc_count++;
+    // schedule the expiry of active auctions
+    for (int aid = 1; aid <= auc_count; ++aid) {
+        struct auction *auc = auction_entry(aid);
+        if (auc->loaded && !auc->ended && expiry_heap_push(auc->start_time + auc->time_active, aid) != 0)
+            return -1;
     }
 
-    if (closedir(dp) != 0) {
-        LOG_DEBUG("[DB] Failed closing DIR *dp, resources may be leaking");
-        LOG_DEBUG("[DB] closedir: %s", strerror(errno));
-    };
+    lap_ms(&lap);
+    LOG_VERBOSE("[DB] Loaded %d auctions", auc_count);
+    LOG("[DB] Database ready in %ld ms", lap_ms(&start));
 
     return 0;
 }
 
 /**
-* Updates the databse by closing auctions that are expired.
+* Get the milliseconds since `lap` and start a new lap
 */
-int update_database() {
-    LOG_DEBUG("[DB] Updating database");
-    lock_db_mutex("update");
-
-    struct dirent **entries;
-    int n_entries = scandir("AUCTIONS", &entries, NULL, NULL);
-    if (n_entries < 0) {
-        LOG_DEBUG("[DB] Failed retrieving user auctions");
-        LOG_DEBUG("[DB] scandir: %s", strerror(errno));
-        unlock_db_mutex("list");
-        return -1;
-    }
+long lap_ms(struct timespec *lap) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long elapsed = (now.tv_sec - lap->tv_sec) * 1000 + (now.tv_nsec - lap->tv_nsec) / 1000000;
+    *lap = now;
+    return elapsed;
+}
 
-    /** 
-    * Iteratively check if each auction has already ended
-    */
-    for (int i = 0; i < n_entries; i++) {
-        if (entries[i]->d_name[0] == '.') {
-            free(entries[i]);
-            continue;
+/**
+* Loads the log engine state from the latest snapshot and the log records written
+* after it. Returns 0 on success and -1 on failure
+*/
+int load_log_state() {
+    struct timespec lap;
+    clock_gettime(CLOCK_MONOTONIC, &lap);
+
+    // without a log, auctions in AUCTIONS belong to the FS engine and the log
+    // engine would reuse their AIDs and overwrite their assets
+    if (access(DB_LOG_FILE, F_OK) != 0 && access(DB_SNAPSHOT_FILE, F_OK) != 0) {
+        struct dir_scan scan;
+        if (dir_scan_open(&scan, AT_FDCWD, "AUCTIONS") != 0) {
+            return -1;
         }
 
-        char bid_path[32];
-        sprintf(bid_path, "AUCTIONS/%.3s/END_%.3s.txt", entries[i]->d_name, entries[i]->d_name);
-        int end_fd;
-
-        // bid has already ended, continue
-        if ((end_fd = open(bid_path, O_RDONLY)) > 0) {
-            if (close(end_fd) != 0) {
-                LOG_DEBUG("[DB] Failed closing file descriptor, resources might be leaking");
-                LOG_DEBUG("[DB] close: %s", strerror(errno));
-            }
-            free(entries[i]);
-            continue;
+        int empty = dir_scan_next(&scan) == NULL;
+        dir_scan_close(&scan);
+        if (!empty) {
+            LOG_ERROR("[DB] %s/AUCTIONS holds auctions of the FS engine and there is no %s", DB_ROOT, DB_LOG_FILE);
+            LOG_ERROR("[DB] Serve them with -b fs, the log engine needs an empty %s (-e exports it for the FS engine)", DB_ROOT);
+            return -1;
         }
+    }
 
-        /**
-        * Get information from START file
-        */
-        FILE *fp;
-        sprintf(bid_path, "AUCTIONS/%.3s/START_%.3s.txt", entries[i]->d_name, entries[i]->d_name);
-        if ((fp = fopen(bid_path, "r")) == NULL) {
-            LOG_DEBUG("[DB] Failed opening bid information file");
-            LOG_DEBUG("[DB] fopen: %s", strerror(errno));
-            free(entries[i]);
-            continue;
-        }
+    unsigned long lsn;
+    if (load_snapshot(&lsn) != 0) {
+        return -1;
+    }
 
-        char bid_info[128];
-        fgets(bid_info, 128, fp);
-        fclose(fp);
+    LOG_VERBOSE("[DB] Snapshot phase took %ld ms", lap_ms(&lap));
 
-        // read auction start time and end time 
-        char *time_active;
-        char *start_time;
+    if (exporting && export_snapshot() != 0) {
+        return -1;
+    }
 
-        // time active is the 5th word in the file
-        strtok(bid_info, " ");    
-        for (int i = 0; i < 4; i++) {
-            time_active = strtok(NULL, " ");    
-        }
+    if (wal_open(DB_LOG_FILE, lsn, replay_record) != 0) {
+        return -1;
+    }
 
-        // start time is the 8th
-        for (int i = 0; i < 3; ++i) {
-            start_time = strtok(NULL, " ");
-        }
+    LOG_VERBOSE("[DB] Log replay phase took %ld ms", lap_ms(&lap));
 
-        // valid both
-        if (time_active == NULL || start_time == NULL) {
-            LOG_DEBUG("Got invaild time active and start time from bid file %s", entries[i]->d_name);
-            free(entries[i]);
-            continue;
-        }
+    // a long log is compacted as soon as the server starts
+    if (records_since_snapshot >= DB_SNAPSHOT_INTERVAL)
+        pthread_cond_signal(&checkpoint_cond);
 
-        if (!is_valid_time_active(time_active)) {
-            LOG_DEBUG("Got invaild time active from bid file %s", entries[i]->d_name);
-            free(entries[i]);
-            continue;
-        }
+    return 0;
+}
 
-        int time_active_i = atoi(time_active);
-        int start_time_l = atol(start_time);
-        long curr_time = time(NULL);
+/**
+* Loads the FS engine state from the users and auctions in the directory layout.
+* Every user and auction directory is loaded by one of DB_LOAD_THREADS threads.
+* Returns 0 on success and -1 on failure
+*/
+int load_fs_state() {
+    struct timespec lap;
+    clock_gettime(CLOCK_MONOTONIC, &lap);
 
-        if (start_time_l == 0) {
-            LOG_DEBUG("Got invaild start time from bid file %s", entries[i]->d_name);
-        }
+    struct dir_scan scan;
+    if (dir_scan_open(&scan, AT_FDCWD, "AUCTIONS") != 0) {
+        LOG_ERROR("[DB] Failed loading database state");
+        return -1;
+    }
 
-        /** 
-        * Check for auction expiration, if not expired, continue
-        */
-        if (curr_time - start_time_l < time_active_i) {
-            free(entries[i]);
-            continue;
+    /**
+    * AIDs are assigned in order, so the last one is the number of auctions in
+    * DB. Extended AIDs live in shard directories, see fs_store_auction_dir()
+    */
+    char *name;
+    int aid;
+    while ((name = dir_scan_next(&scan)) != NULL) {
+        if (name[0] == 'X' && sscanf(name + 1, "%d", &aid) == 1) {
+            int last = last_sharded_aid(scan.fd, name);
+            auc_count = last > auc_count ? last : auc_count;
         }
-
-        /** 
-        * If auction expired, create END file and write to it the date time of 
-        * the auction end and the time in seconds it remained active
-        */
-        // create END file
-        int close_fd;
-        sprintf(bid_path, "AUCTIONS/%.3s/END_%.3s.txt", entries[i]->d_name, entries[i]->d_name);
-        if ((close_fd = open(bid_path, O_CREAT | O_WRONLY, SERVER_MODE)) < 0) {
-            LOG_DEBUG("[DB] Failed creating END_%.3s.txt file", entries[i]->d_name);
-            LOG_DEBUG("[DB] open: %s", strerror(errno));
-            free(entries[i]);
-            continue;
+        else if (sscanf(name, "%d", &aid) == 1) {
+            auc_count = aid > auc_count ? aid : auc_count;
         }
+    }
 
-        if (close(close_fd) != 0) {
-            LOG_DEBUG("[DB] Failed closing file descriptor, resources might be leaking");
-            LOG_DEBUG("[DB] close: %s", strerror(errno));
-        }
+    dir_scan_close(&scan);
+    LOG_VERBOSE("[DB] Auction count phase took %ld ms", lap_ms(&lap));
 
-        // get datetime to put in END file
-        long end_sec_time = start_time_l + time_active_i;
-        struct tm *tm_time;
-        if ((tm_time = gmtime(&end_sec_time)) == NULL) {
-            LOG_DEBUG("[DB] Couldn't get current time information")
-            free(entries[i]);
-            continue;
-        }
+    if (load_users() != 0) {
+        return -1;
+    }
 
-        char time_str[128];
-        sprintf(time_str, "%4d-%02d-%02d %02d:%02d:%02d", 
-                    tm_time->tm_year + 1900, tm_time->tm_mon + 1, tm_time->tm_mday,
-                    tm_time->tm_hour, tm_time->tm_min, tm_time->tm_sec);
-
-        char end_info[256];
-        sprintf(end_info, "%s %d\n", time_str, time_active_i);
- 
-        // write information to END file
-        if ((fp = fopen(bid_path, "w")) == NULL) {
-            LOG_DEBUG("[DB] Failed opening bid end information file");
-            LOG_DEBUG("[DB] fopen: %s", strerror(errno));
-            free(entries[i]);
-            continue;
+    LOG_VERBOSE("[DB] User load phase took %ld ms", lap_ms(&lap));
+
+    if (auc_count > max_auctions) {
+        LOG_ERROR("[DB] Found %d auctions in database, only %d are supported", auc_count, max_auctions);
+        LOG_ERROR("[DB] Start the server with extended AIDs to load them");
+        return -1;
+    }
+
+    // build the in-memory auction table
+    for (int aid = 1; aid <= auc_count; ++aid) {
+        if (alloc_auction_entry(aid) == NULL) {
+            return -1;
         }
+    }
 
-        fputs(end_info, fp);
-        fclose(fp);
-        free(entries[i]);
+    struct load_job job = { .n = auc_count, .next = 0 };
+    if (run_load_job(&job, load_auctions_fn) != 0) {
+        return -1;
     }
 
-    free(entries);
+    LOG_VERBOSE("[DB] Auction load phase took %ld ms", lap_ms(&lap));
 
-    unlock_db_mutex("list");
-    return 0;
+    return write_behind_start(export_record);
 }
 
 /**
-* Check if user is registred in DB 
+* Runs a load job with DB_LOAD_THREADS threads, which call `load_fn` with the
+* job. Returns 0 on success and -1 on failure
 */
-int exists_user(char *uid) {
-    char user_passwd_path[256];
-    FILE *fp;
-
-    lock_db_mutex(uid);
-    // check password file
-    sprintf(user_passwd_path, "USERS/%6s/%6s_pass.txt", uid, uid);
-    if ((fp = fopen(user_passwd_path, "r")) == NULL) {
-        unlock_db_mutex(uid);
-        return 0;
+int run_load_job(struct load_job *job, void *(*load_fn)(void *)) {
+    pthread_t threads[DB_LOAD_THREADS];
+    int n_threads = 0;
+    for (; n_threads < DB_LOAD_THREADS && n_threads < job->n; ++n_threads) {
+        if (pthread_create(&threads[n_threads], NULL, load_fn, job) != 0) {
+            LOG_ERROR("[DB] Failed creating database load thread");
+            break;
+        }
     }
 
-    fclose(fp);
-
-    unlock_db_mutex(uid);
+    // the threads that were created load every item
+    for (int i = 0; i < n_threads; ++i)
+        pthread_join(threads[i], NULL);
 
-    return 1;
+    return n_threads > 0 || job->n == 0 ? 0 : -1;
 }
 
 /**
-* Checks if user is logged in
+* Loads the auctions of a job, which are numbered from 1
 */
-int is_user_logged_in(char *uid) {
-    lock_db_mutex(uid);
+void *load_auctions_fn(void *arg) {
+    struct load_job *job = arg;
+    int aid;
+    while ((aid = __atomic_add_fetch(&job->next, 1, __ATOMIC_RELAXED)) <= job->n) {
+        if (load_auction(aid) != 0) {
+            LOG_DEBUG("[DB] Failed loading auction %03d, database might be corrupted", aid);
+        }
+    }
 
-    FILE *fp;
-    char user_login_path[64];
-    sprintf(user_login_path, "USERS/%6s/%6s_login.txt", uid, uid);
-    if ((fp = fopen(user_login_path, "r")) == NULL) {
-        unlock_db_mutex(uid);
+    return NULL;
+}
+
+/**
+* Returns the last AID in an AUCTIONS/Xnnn shard directory, 0 if it is empty
+*/
+int last_sharded_aid(int auctions_fd, char *shard) {
+    struct dir_scan scan;
+    if (dir_scan_open(&scan, auctions_fd, shard) != 0) {
         return 0;
     }
 
-    fclose(fp);
+    char *name;
+    int last = 0, aid;
+    while ((name = dir_scan_next(&scan)) != NULL) {
+        if (sscanf(name, "%d", &aid) == 1 && aid > last)
+            last = aid;
+    }
 
-    unlock_db_mutex(uid);
-    return 1;
+    dir_scan_close(&scan);
+    return last;
 }
 
 /**
-* Check if an auction exists in the database (this is like this for now, must check later)
+* The memory engine starts with an empty database
 */
-int exists_auction(char *aid) {
-    lock_db_mutex(aid);
-
-    int aid_int = atoi(aid);
-    int ret = (aid_int <= auc_count && aid_int > 0);
+int load_mem_state() {
+    return 0;
+}
 
-    unlock_db_mutex(aid);
-    return ret; 
+/**
+* The memory engine doesn't persist records, they are only applied
+*/
+int persist_mem_record(struct wal_record *rec) {
+    return 0;
 }
 
-int is_auction_finished(char *aid) {
-    lock_db_mutex(aid);
+/**
+* The FS and memory engines have no log to sync. The FS engine acknowledges a
+* record once it is queued, see close_database()
+*/
+int sync_unlogged_record(struct wal_record *rec) {
+    return 0;
+}
 
-    FILE *fp;
-    char auc_path[64];
-    sprintf(auc_path, "AUCTIONS/%3s/END_%3s.txt", aid, aid);
-    if ((fp = fopen(auc_path, "r")) == NULL) {
-        unlock_db_mutex(aid);
-        return 0;
+/**
+* Loads an auction into the in-memory auction table, from its record in the
+* auction table file or, if it has none, from its START and END files, and its
+* last bids from its BIDS directory. Returns 0 on success and -1 if the auction
+* has no record and its START file is missing or badly formatted.
+*/
+int load_auction(int aid) {
+    struct auction *auc = auction_entry(aid);
+    memset(auc, 0, sizeof(struct auction));
+
+    int auc_fd;
+    char auc_dir[32];
+    fs_store_auction_dir(aid, auc_dir);
+    if ((auc_fd = open(auc_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) {
+        LOG_DEBUG("[DB] open: %s", strerror(errno));
+        return -1;
     }
 
-    fclose(fp);
-
-    unlock_db_mutex(aid);
-    return 1;
-}
+    struct auction_record rec;
+    int in_table = fs_store_read_auction(aid, &rec) == 0;
+    if (in_table) {
+        strncpy(auc->uid, rec.uid, UID_SIZE);
+        strncpy(auc->name, rec.name, ASSET_NAME_LEN);
+        strncpy(auc->fname, rec.fname, FNAME_LEN);
+        auc->start_value = rec.start_value;
+        auc->time_active = rec.time_active;
+        auc->start_time = rec.start_time;
+        format_datetime(rec.start_time, auc->start_datetime);
+        if (rec.status == AUCTION_RECORD_ENDED) {
+            auc->ended = 1;
+            auc->end_sec_time = rec.end_time - rec.start_time;
+            format_datetime(rec.end_time, auc->end_datetime);
+        }
+    } else if (load_auction_files(auc, aid, auc_fd) != 0) {
+        close(auc_fd);
+        return -1;
+    }
 
-int get_auction_info(char *aid, char *buff, int n) {
-    lock_db_mutex(aid);
+    auc->loaded = 1;
 
-    FILE *fp;
-    char auction_path[64];
-    sprintf(auction_path, "AUCTIONS/%3s/START_%3s.txt", aid, aid);
-    if ((fp = fopen(auction_path, "r")) == NULL) {
-        LOG_DEBUG("[DB] Failed reading from auction %s information file, databsae might be corrupted", aid);
-        unlock_db_mutex(aid);
-        return 1;
+    if (load_bids(auc, auc_fd) != 0) {
+        LOG_DEBUG("[DB] Failed loading auction %03d bids", aid);
     }
 
-    if (fgets(buff, n, fp) == NULL) {
-        fclose(fp);
-        LOG_DEBUG("[DB] Failed reading from auction %s information file, database might be corrupted", aid);
-        unlock_db_mutex(aid);
-        return 1;
-    };
+    close(auc_fd);
 
-    fclose(fp);
-
-    unlock_db_mutex(aid);
+    // auctions written before the table existed get their record now
+    if (!in_table) {
+        memset(&rec, 0, sizeof(rec));
+        strcpy(rec.uid, auc->uid);
+        strcpy(rec.name, auc->name);
+        strcpy(rec.fname, auc->fname);
+        rec.start_value = auc->start_value;
+        rec.time_active = auc->time_active;
+        rec.start_time = auc->start_time;
+        rec.end_time = auc->ended ? auc->start_time + auc->end_sec_time : 0;
+        rec.status = auc->ended ? AUCTION_RECORD_ENDED : AUCTION_RECORD_OPEN;
+        rec.top_bid = auc->top_bid;
+        strcpy(rec.top_bidder, auc->top_bidder);
+        fs_store_write_auction(aid, &rec);
+    }
 
     return 0;
 }
 
-int get_user_auctions(char *uid, char *buff) {
-    lock_db_mutex(uid);
-
-    struct dirent **entries;
-    char user_hosted_path[32];
-    sprintf(user_hosted_path, "USERS/%.6s/HOSTED", uid);
-    int n_entries = scandir(user_hosted_path, &entries, NULL, alphasort);
-    if (n_entries < 0) {
-        LOG_DEBUG("[DB] Failed retrieving user auctions");
-        LOG_DEBUG("[DB] scandir: %s", strerror(errno));
-        unlock_db_mutex(uid);
+/**
+* Loads an auction's START and END files, for auctions written before the
+* auction table existed. Returns 0 on success and -1 if the START file is missing
+* or badly formatted.
+*/
+int load_auction_files(struct auction *auc, int aid, int auc_fd) {
+    char file_name[32];
+    char line[256];
+    sprintf(file_name, "START_%03d.txt", aid);
+    if (read_small_file(auc_fd, file_name, line, sizeof(line)) <= 0) {
+        LOG_DEBUG("[DB] Failed reading START file of auction %03d", aid);
         return -1;
     }
 
-    int written = 0;
-    char hosted_auc_path[32];
-    int check_fd;
-    for (int i = 0; i < n_entries; i++) {
-        // ignore hidden files
-        if (entries[i]->d_name[0] == '.') continue;
-
-        char asset_status[128];
-        // check each auction status (if it's ended)
-        sprintf(hosted_auc_path, "AUCTIONS/%.3s/END_%.3s.txt", entries[i]->d_name, entries[i]->d_name);
-        if ((check_fd = open(hosted_auc_path, 0, SERVER_MODE)) < 0) {
-            sprintf(asset_status, " %.3s 1", entries[i]->d_name); // not ended
-        } else {
-            sprintf(asset_status, " %.3s 0", entries[i]->d_name); // ended
-            if (close(check_fd) != 0) {
-                LOG_DEBUG("[DB] Failed closing file descriptor, resources might be leaking");
-                LOG_DEBUG("[DB] close: %s", strerror(errno));
-            };
-        }
-        strcat(buff, asset_status);
-        written += strlen(asset_status);
-
-        free(entries[i]);
+    // "%s %s %s %d %d %s %ld\n", uid, name, fname, sv, ta, str_time, unix_start_time
+    char date[16], time[16];
+    if (sscanf(line, "%6s %10s %24s %d %d %10s %8s %ld", auc->uid, auc->name, auc->fname,
+                &auc->start_value, &auc->time_active, date, time, &auc->start_time) != 8) {
+        LOG_DEBUG("[DB] Got a badly formatted START_%03d file", aid);
+        return -1;
     }
-    
-    free(entries);
 
-    strcat(buff, "\n");
-    written += 1;
+    sprintf(auc->start_datetime, "%.10s %.8s", date, time);
 
-    unlock_db_mutex(uid);
+    // check if the auction has ended
+    sprintf(file_name, "END_%03d.txt", aid);
+    if (read_small_file(auc_fd, file_name, line, sizeof(line)) >= 0) {
+        auc->ended = 1;
+        if (sscanf(line, "%10s %8s %ld", date, time, &auc->end_sec_time) == 3) {
+            sprintf(auc->end_datetime, "%.10s %.8s", date, time);
+        }
+    }
 
-    return written;
+    return 0;
 }
 
-int get_auctions_list(char *buff) {
-    lock_db_mutex("list");
+int compare_ints(const void *a, const void *b) {
+    return *(const int *)a - *(const int *)b;
+}
 
-    struct dirent **entries;
-    int n_entries = scandir("AUCTIONS", &entries, NULL, alphasort);
-    if (n_entries < 0) {
-        LOG_DEBUG("[DB] Failed retrieving user auctions");
-        LOG_DEBUG("[DB] scandir: %s", strerror(errno));
-        unlock_db_mutex("list");
+/**
+* Loads the last MAX_SHOWN_BIDS bids of an auction from its BIDS directory into
+* its ring of recent bids. Returns 0 on success and -1 on failure
+*/
+int load_bids(struct auction *auc, int auc_fd) {
+    struct dir_scan scan;
+    if (dir_scan_open(&scan, auc_fd, "BIDS") != 0) {
         return -1;
     }
 
-    /** Iterate all auctions */
-    int written = 0;
-    char curr_auc_path[32];
-    int check_fd;
-    for (int i = 0; i < n_entries; i++) {
-        if (entries[i]->d_name[0] == '.') continue;
-
-        // path to current auction "AUCTIONS/001/END_001.txt"
-        sprintf(curr_auc_path, "AUCTIONS/%.3s/END_%.3s.txt", entries[i]->d_name, entries[i]->d_name);
-        char auc_status[8];
-        if ((check_fd = open(curr_auc_path, 0, SERVER_MODE)) < 0) {
-            sprintf(auc_status, " %.3s 1", entries[i]->d_name); // not ended
-        } else {
-            sprintf(auc_status, " %.3s 0", entries[i]->d_name); // ended
-            if (close(check_fd) != 0) {
-                LOG_DEBUG("[DB] Failed closing file descriptor, resources might be leaking")
-                LOG_DEBUG("[DB] closedir: %s", strerror(errno));
-            };
-        }
+    // bid files are named after their value, VVVVVV.txt
+    int *values = NULL;
+    int n_values = 0, values_size = 0;
+    int value;
+    char *name;
+    while ((name = dir_scan_next(&scan)) != NULL) {
+        if (sscanf(name, "%d.txt", &value) != 1)
+            continue;
+
+        if (n_values == values_size) {
+            values_size = values_size == 0 ? 64 : values_size * 2;
+            int *tmp = realloc(values, values_size * sizeof(int));
+            if (tmp == NULL) {
+                free(values);
+                dir_scan_close(&scan);
+                return -1;
+            }
 
-        strcat(buff, auc_status);
-        written += strlen(auc_status);
+            values = tmp;
+        }
 
-        free(entries[i]);
+        values[n_values++] = value;
     }
 
-    free(entries);
+    // bids are placed by increasing value, the last ones are the biggest
+    qsort(values, n_values, sizeof(int), compare_ints);
+
+    int first = n_values > MAX_SHOWN_BIDS ? n_values - MAX_SHOWN_BIDS : 0;
+    auc->n_placed = first;
+    for (int i = first; i < n_values; ++i) {
+        // "%s %s %ld\n", uid, bid_datetime, bid_sec_time
+        char bid_name[32];
+        char line[128];
+        sprintf(bid_name, "%06d.txt", values[i]);
+        if (read_small_file(scan.fd, bid_name, line, sizeof(line)) < 0) {
+            LOG_DEBUG("[DB] Failed reading bid file %s", bid_name);
+            continue;
+        }
 
-    strcat(buff, "\n");
-    written += 1;
+        struct bid new_bid;
+        char date[16], time[16];
+        new_bid.value = values[i];
+        if (sscanf(line, "%6s %10s %8s %ld", new_bid.uid, date, time, &new_bid.sec_time) != 4 ||
+            !is_valid_uid(new_bid.uid) || !is_valid_date_time(date, time)) {
+            LOG_DEBUG("[DB] Got a badly formatted bid file %s", bid_name);
+            continue;
+        }
 
-    unlock_db_mutex("list");
+        sprintf(new_bid.datetime, "%.10s %.8s", date, time);
+        push_recent_bid(auc, &new_bid);
+    }
 
+    free(values);
+    dir_scan_close(&scan);
 
-    return written;
+    return 0;
 }
 
-int get_auction_bidders_list(char *aid, char *buff) {
-    lock_db_mutex("bidders list");
+/**
+* Adds a bid to an auction's ring of recent bids, replacing the oldest one once
+* the ring is full, and makes it the highest bid
+*/
+void push_recent_bid(struct auction *auc, struct bid *new_bid) {
+    auc->recent_bids[auc->n_placed++ % MAX_SHOWN_BIDS] = *new_bid;
+    auc->top_bid = new_bid->value;
+    strncpy(auc->top_bidder, new_bid->uid, UID_SIZE + 1);
+}
 
-    struct dirent **entries;
-    char bids_path[32];
-    sprintf(bids_path, "AUCTIONS/%.3s/BIDS", aid);
-    int n_entries = scandir(bids_path, &entries, NULL, alphasort);
-    if (n_entries < 0) { // couldn't scan directory
-        LOG_DEBUG("Failed retrieving auction %s bids", aid);
-        LOG_DEBUG("scandir: %s", strerror(errno));
-        unlock_db_mutex("bidders list");
+/**
+* Loads the users in the USERS directory into the in-memory users, with a load
+* job per user. Returns 0 on success and -1 on failure
+*/
+int load_users() {
+    struct load_job job = {0};
+    struct dir_scan scan;
+    if (dir_scan_open(&scan, AT_FDCWD, "USERS") != 0) {
+        LOG_ERROR("[DB] Failed loading users");
         return -1;
     }
 
-    // get rid of '.' and '..'
-    free(entries[0]);
-    free(entries[1]);
-
-    // we start after '.' and '..', we assume alphabetically they are always first, if no one
-    // tampers with database manually this is true
-    int first_entry = 2;
-    // if more than 50 auctions exist we retrieve the most 50 recent ones, 50 biggest bid values
-    if (n_entries > 52)
-        first_entry = n_entries - 50;
-
-    int written = 0;         // bytes written to buff
-    char curr_bid_path[32]; // bid path 
-    char bid_info[128];      // information about currently iterated bid
-    for (int i = first_entry; i < n_entries; ++i) {
-        FILE *fp;
-        // iterated bid "AUCTIONS/001/BIDS/000100.txt"
-        sprintf(curr_bid_path, "AUCTIONS/%.3s/BIDS/%.10s", aid, entries[i]->d_name);
-        if ((fp = fopen(curr_bid_path, "r")) == NULL) {
-            LOG_DEBUG("Failed opening bid file");
-            free(entries[i]);
-            continue;
-        }
-        
-        // retrieve information about bid
-        if (fgets(bid_info, 128, fp) < 0) {
-            LOG_DEBUG("Failed getting bid information");
-            fclose(fp);
-            free(entries[i]);
+    int size = 0;
+    char *name;
+    while ((name = dir_scan_next(&scan)) != NULL) {
+        if (!is_valid_uid(name))
             continue;
-        };
 
-        fclose(fp);
+        if (job.n == size) {
+            size = size == 0 ? 1024 : size * 2;
+            int *items = realloc(job.items, size * sizeof(int));
+            if (items == NULL) {
+                free(job.items);
+                dir_scan_close(&scan);
+                return -1;
+            }
 
-        // first field, bidder UID
-        char *bidder_uid = strtok(bid_info, " ");
-        if (bidder_uid == NULL) {
-            LOG_DEBUG("Got null bidder uid");
-            free(entries[i]);
-            continue;
+            job.items = items;
         }
 
-        if (!is_valid_uid(bidder_uid)) {
-            LOG_DEBUG("Got invalid bidder UID")
-            free(entries[i]);
-            continue;
-        }
+        job.items[job.n++] = atoi(name);
+    }
 
-        // second field, bid date in format YYYY-MM-DD
-        char *bid_date = strtok(NULL, " ");
-        if (bid_date == NULL) {
-            LOG_DEBUG("Got no bid date");
-            free(entries[i]);
-            continue;
-        }
+    // users are loaded relative to the USERS directory
+    job.fd = scan.fd;
+    int ret = run_load_job(&job, load_users_fn);
 
-        // third field, bid time in format HH:MM:SS
-        char *bid_time = strtok(NULL, " ");
-        if (bid_time == NULL) {
-            LOG_DEBUG("Got no bid time");
-            free(entries[i]);
-            continue;
-        }
+    dir_scan_close(&scan);
+    free(job.items);
 
-        if (!is_valid_date_time(bid_date, bid_time)) {
-            LOG_DEBUG("Invalid date time");
-            free(entries[i]);
-            continue;
-        }
+    if (ret == 0)
+        LOG_VERBOSE("[DB] Loaded %d users", job.n);
+
+    return ret;
+}
+
+/**
+* Loads the users of a job, whose items are UIDs
+*/
+void *load_users_fn(void *arg) {
+    struct load_job *job = arg;
+    int i;
+    while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->n) {
+        char uid[UID_SIZE + 1];
+        sprintf(uid, "%06d", job->items[i]);
+        if (load_user(job->fd, uid) != 0) {
+            LOG_DEBUG("[DB] Failed loading user %s, database might be corrupted", uid);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+* Loads a user from their directory in USERS. A user is registered if they have
+* a password file and logged in if they have a login file. Returns 0 on success
+* and -1 on failure
+*/
+int load_user(int users_fd, char *uid) {
+    // every UID is loaded by a single thread
+    long uid_int = atol(uid) % MAX_USERS;
+    if (users[uid_int] == NULL && (users[uid_int] = calloc(1, sizeof(struct user))) == NULL) {
+        return -1;
+    }
+
+    struct user *user = users[uid_int];
+
+    int user_fd;
+    if ((user_fd = openat(users_fd, uid, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) {
+        LOG_DEBUG("[DB] openat: %s", strerror(errno));
+        return -1;
+    }
+
+    char file_name[32];
+    char passwd[32];
+    int registered = 0;
+    sprintf(file_name, "%.6s_pass.txt", uid);
+    if (read_small_file(user_fd, file_name, passwd, sizeof(passwd)) > 0) {
+        passwd[strcspn(passwd, "\n")] = '\0';
+        strncpy(user->passwd, passwd, PASSWORD_SIZE);
+        registered = 1;
+    }
+
+    sprintf(file_name, "%.6s_login.txt", uid);
+    set_user_state(uid_int, registered, registered && faccessat(user_fd, file_name, F_OK, 0) == 0);
+
+    if (load_user_auctions(user_fd, "HOSTED", &user->hosted) != 0) {
+        LOG_DEBUG("[DB] Failed loading user %.6s hosted auctions", uid);
+    }
+
+    if (load_user_auctions(user_fd, "BIDDED", &user->bidded) != 0) {
+        LOG_DEBUG("[DB] Failed loading user %.6s bidded auctions", uid);
+    }
+
+    close(user_fd);
+
+    return 0;
+}
+
+/**
+* Loads the auctions in a user's HOSTED or BIDDED directory, whose entries are
+* named AID.txt, into a set of AIDs. Returns 0 on success and -1 on failure
+*/
+int load_user_auctions(int user_fd, char *path, struct aid_set *set) {
+    struct dir_scan scan;
+    if (dir_scan_open(&scan, user_fd, path) != 0) {
+        return -1;
+    }
+
+    char *name;
+    int aid;
+    while ((name = dir_scan_next(&scan)) != NULL) {
+        if (sscanf(name, "%d.txt", &aid) == 1 && aid_set_add(set, aid) != 0) {
+            dir_scan_close(&scan);
+            return -1;
+        }
+    }
+
+    dir_scan_close(&scan);
+
+    return 0;
+}
+
+/**
+* Adds an auction to a set of AIDs, if it isn't there yet. Returns 0 on success
+* and -1 on failure
+*/
+int aid_set_add(struct aid_set *set, int aid) {
+    // AIDs are mostly added in increasing order, so look from the end
+    int i = set->n;
+    while (i > 0 && set->aids[i - 1] > aid)
+        i--;
+
+    if (i > 0 && set->aids[i - 1] == aid)
+        return 0;
+
+    if (set->n == set->size) {
+        int size = set->size == 0 ? 8 : set->size * 2;
+        int *aids = realloc(set->aids, size * sizeof(int));
+        if (aids == NULL)
+            return -1;
+
+        set->aids = aids;
+        set->size = size;
+    }
+
+    memmove(&set->aids[i + 1], &set->aids[i], (set->n - i) * sizeof(int));
+    set->aids[i] = aid;
+    set->n++;
+
+    return 0;
+}
+
+/**
+* Writes " AID state" for the auctions in a set of AIDs into buff, by increasing
+* AID. Only the last MAX_LISTED_AUCTIONS are written, so the reply fits in a
+* datagram, and never more than size - 1 bytes, leaving room for the final '\n'.
+* Returns the number of bytes written
+*/
+int write_aid_set(struct aid_set *set, char *buff, int size) {
+    int written = 0;
+    int count = get_auction_count();
+    int first = set->n > MAX_LISTED_AUCTIONS ? set->n - MAX_LISTED_AUCTIONS : 0;
+    for (int i = first; i < set->n && set->aids[i] <= count; ++i) {
+        // state is 0 if the auction has ended
+        int aid = set->aids[i];
+        int ended = __atomic_load_n(&auction_entry(aid)->ended, __ATOMIC_ACQUIRE);
+        int n = snprintf(buff + written, size - written, " %03d %d", aid, !ended);
+        if (n >= size - written - 1)
+            break;
+
+        written += n;
+    }
+
+    return written;
+}
+
+/**
+* Get the entry of an auction in the auction table, its chunk must be allocated
+*/
+struct auction *auction_entry(int aid) {
+    return &auction_chunks[aid / AUCTION_CHUNK_SIZE][aid % AUCTION_CHUNK_SIZE];
+}
+
+/**
+* Get the entry of an auction in the auction table, allocating its chunk if it
+* doesn't exist yet. Returns NULL on failure
+*/
+struct auction *alloc_auction_entry(int aid) {
+    if (aid <= 0 || aid > MAX_EXT_AUCTIONS)
+        return NULL;
+
+    struct auction **chunk = &auction_chunks[aid / AUCTION_CHUNK_SIZE];
+    if (*chunk == NULL && (*chunk = calloc(AUCTION_CHUNK_SIZE, sizeof(struct auction))) == NULL) {
+        LOG_ERROR("[DB] Failed allocating the auction table");
+        return NULL;
+    }
+
+    return auction_entry(aid);
+}
+
+/**
+* Get an auction from the in-memory table. Returns NULL if it doesn't exist
+*/
+struct auction *get_auction(char *aid) {
+    int aid_int = atoi(aid);
+    if (aid_int <= 0 || aid_int > get_auction_count())
+        return NULL;
+
+    return auction_entry(aid_int);
+}
+
+/**
+* Number of auctions published in the auction table
+*/
+int get_auction_count() {
+    return __atomic_load_n(&auc_count, __ATOMIC_ACQUIRE);
+}
+
+/**
+* Get the version of the auctions list. Anything read from the list after this
+* call is at least as recent as the version returned
+*/
+unsigned long get_db_version() {
+    return __atomic_load_n(&db_version, __ATOMIC_ACQUIRE);
+}
+
+/**
+* Get an in-memory user, must be called with the user's lock held. Returns NULL
+* if the user never registered
+*/
+struct user *get_user(char *uid) {
+    return users[atoi(uid) % MAX_USERS];
+}
+
+/**
+* Writes the UTC datetime of `t` into buff in the format YYYY-MM-DD HH:MM:SS
+*/
+void format_datetime(time_t t, char *buff) {
+    struct tm tm_time;
+    gmtime_r(&t, &tm_time);
+    sprintf(buff, "%4d-%02d-%02d %02d:%02d:%02d",
+                tm_time.tm_year + 1900, tm_time.tm_mon + 1, tm_time.tm_mday,
+                tm_time.tm_hour, tm_time.tm_min, tm_time.tm_sec);
+}
+
+/**
+* Current UNIX time in seconds, read from the clock of the expiry timer. time()
+* reads a coarser clock, which can still be behind a deadline the timer reached
+*/
+long current_time() {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec;
+}
+
+/**
+* Zeroes a record and fills its common fields, its time is set to the current time
+*/
+void init_record(struct wal_record *rec, wal_record_t type, int aid, char *uid) {
+    memset(rec, 0, sizeof(struct wal_record));
+    rec->type = type;
+    rec->aid = aid;
+    rec->time = current_time();
+    if (uid != NULL)
+        strncpy(rec->uid, uid, UID_SIZE);
+}
+
+/**
+* Persists a record with the selected engine. Returns 0 on success and -1 on failure
+*/
+int persist_record(struct wal_record *rec) {
+    return engine->persist(rec);
+}
+
+/**
+* Persists a record and applies it to the in-memory state, with the state locked
+* against snapshots. Returns 0 on success and -1 if the record couldn't be persisted
+*/
+int commit_record(struct wal_record *rec) {
+    pthread_rwlock_rdlock(&state_lock);
+
+    if (persist_record(rec) != 0) {
+        pthread_rwlock_unlock(&state_lock);
+        return -1;
+    }
+
+    if (apply_record(rec) != 0) {
+        LOG_ERROR("[DB] Failed applying record of type %d to the database state", rec->type);
+    }
+
+    pthread_rwlock_unlock(&state_lock);
+
+    // wake up the checkpoint thread once enough records have been written
+    if (engine->checkpoints &&
+        __atomic_add_fetch(&records_since_snapshot, 1, __ATOMIC_RELAXED) == DB_SNAPSHOT_INTERVAL) {
+        pthread_mutex_lock(&checkpoint_mutex);
+        pthread_cond_signal(&checkpoint_cond);
+        pthread_mutex_unlock(&checkpoint_mutex);
+    }
+
+    return 0;
+}
+
+/**
+* Waits until a committed record is durable, as set by set_database_durability().
+* Must be called without locks held, so other commits can join its sync.
+* Returns 0, the server exits if the record couldn't be synced
+*/
+int sync_record(struct wal_record *rec) {
+    return engine->sync(rec);
+}
+
+/**
+* Writes a record in the directory layout. The times of bids and auction ends are
+* relative to the auction start, so their auction must be in the auction table.
+* Returns 0 on success and -1 on failure
+*/
+int export_record(struct wal_record *rec) {
+    char datetime[32];
+    format_datetime(rec->time, datetime);
+
+    switch (rec->type) {
+        case WAL_REGISTER:   return fs_store_register(rec->uid, rec->passwd);
+        case WAL_UNREGISTER: return fs_store_unregister(rec->uid);
+        case WAL_LOGIN:      return fs_store_login(rec->uid);
+        case WAL_LOGOUT:     return fs_store_logout(rec->uid);
+        case WAL_OPEN:
+            return fs_store_open(rec->aid, rec->uid, rec->name, rec->fname,
+                                    rec->value, rec->time_active, datetime, rec->time);
+    }
+
+    if (rec->aid <= 0 || rec->aid > auc_count)
+        return -1;
+
+    long sec_time = rec->time - auction_entry(rec->aid)->start_time;
+    switch (rec->type) {
+        case WAL_BID:        return fs_store_bid(rec->aid, rec->uid, rec->value, datetime, sec_time);
+        case WAL_CLOSE:
+        case WAL_EXPIRE:     return fs_store_end(rec->aid, datetime, sec_time);
+    }
+
+    return -1;
+}
+
+/**
+* Applies a user record to the in-memory users
+*/
+int apply_user_record(struct wal_record *rec) {
+    int uid = atoi(rec->uid) % MAX_USERS;
+    if (users[uid] == NULL && rec->type == WAL_REGISTER)
+        users[uid] = calloc(1, sizeof(struct user));
+
+    struct user *user = users[uid];
+    if (user == NULL)
+        return -1;
+
+    switch (rec->type) {
+        case WAL_REGISTER: // registering also logs in the user
+            strncpy(user->passwd, rec->passwd, PASSWORD_SIZE);
+            set_user_state(uid, 1, 1);
+            break;
+
+        case WAL_UNREGISTER:
+            set_user_state(uid, 0, 0);
+            break;
+
+        case WAL_LOGIN:
+            set_user_state(uid, 1, 1);
+            break;
+
+        case WAL_LOGOUT:
+            set_user_state(uid, 1, 0);
+            break;
+    }
+
+    return 0;
+}
+
+/**
+* Adds a bid to the bids kept by the log engine
+*/
+int apply_bid_record(struct auction *auc, struct bid *new_bid) {
+    if (!engine->keeps_bids)
+        return 0;
+
+    if (auc->n_bids == auc->bids_size) {
+        int size = auc->bids_size == 0 ? 16 : auc->bids_size * 2;
+        struct bid *bids = realloc(auc->bids, size * sizeof(struct bid));
+        if (bids == NULL)
+            return -1;
+
+        auc->bids = bids;
+        auc->bids_size = size;
+    }
+
+    auc->bids[auc->n_bids++] = *new_bid;
+
+    return 0;
+}
+
+/**
+* Applies a persisted record to the in-memory state, must be called with the
+* locks of the resources the record changes held. Returns 0 on success and -1 if
+* the record doesn't apply to the current state
+*/
+int apply_record(struct wal_record *rec) {
+    if (rec->type == WAL_REGISTER || rec->type == WAL_UNREGISTER ||
+        rec->type == WAL_LOGIN || rec->type == WAL_LOGOUT) {
+        return apply_user_record(rec);
+    }
+
+    if (rec->type == WAL_OPEN) {
+        if (rec->aid != auc_count + 1 || rec->aid > max_auctions)
+            return -1;
+
+        struct auction *auc = alloc_auction_entry(rec->aid);
+        if (auc == NULL)
+            return -1;
+
+        memset(auc, 0, sizeof(struct auction));
+        strncpy(auc->uid, rec->uid, UID_SIZE);
+        strncpy(auc->name, rec->name, ASSET_NAME_LEN);
+        strncpy(auc->fname, rec->fname, FNAME_LEN);
+        auc->start_value = rec->value;
+        auc->time_active = rec->time_active;
+        auc->start_time = rec->time;
+        format_datetime(rec->time, auc->start_datetime);
+        auc->loaded = 1;
+
+        struct user *host = get_user(rec->uid);
+        if (host != NULL && aid_set_add(&host->hosted, rec->aid) != 0)
+            return -1;
+
+        // publish the auction
+        __atomic_store_n(&auc_count, rec->aid, __ATOMIC_RELEASE);
+        __atomic_add_fetch(&db_version, 1, __ATOMIC_RELEASE);
+        return 0;
+    }
+
+    if (rec->aid <= 0 || rec->aid > auc_count)
+        return -1;
+
+    struct auction *auc = auction_entry(rec->aid);
+    if (rec->type == WAL_BID) {
+        struct bid new_bid;
+        strncpy(new_bid.uid, rec->uid, UID_SIZE + 1);
+        new_bid.value = rec->value;
+        format_datetime(rec->time, new_bid.datetime);
+        new_bid.sec_time = rec->time - auc->start_time;
+        push_recent_bid(auc, &new_bid);
+        auc->version++;
+
+        struct user *bidder = get_user(rec->uid);
+        if (bidder != NULL && aid_set_add(&bidder->bidded, rec->aid) != 0)
+            return -1;
+
+        return apply_bid_record(auc, &new_bid);
+    }
+
+    if (rec->type == WAL_CLOSE || rec->type == WAL_EXPIRE) {
+        format_datetime(rec->time, auc->end_datetime);
+        auc->end_sec_time = rec->time - auc->start_time;
+        __atomic_store_n(&auc->ended, 1, __ATOMIC_RELEASE);
+        auc->version++;
+        __atomic_add_fetch(&db_version, 1, __ATOMIC_RELEASE);
+
+        // the cached response shows the auction as active, it is only cached
+        // again if the auction is still shown after its end
+        drop_cached_auction_record(&auc->src);
+        return 0;
+    }
+
+    return -1;
+}
+
+/**
+* Applies a record read from the log when the database is loaded. When exporting,
+* the record is also written in the directory layout
+*/
+int replay_record(struct wal_record *rec) {
+    records_since_snapshot++;
+
+    if (apply_record(rec) != 0)
+        return -1;
+
+    if (exporting && export_record(rec) != 0) {
+        LOG_DEBUG("[DB] Failed exporting record %lu", rec->lsn);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+* Blocks until the log engine has written DB_SNAPSHOT_INTERVAL records since the
+* last snapshot. Never returns with the FS engine
+*/
+void wait_checkpoint() {
+    pthread_mutex_lock(&checkpoint_mutex);
+    while (!engine->checkpoints ||
+            __atomic_load_n(&records_since_snapshot, __ATOMIC_RELAXED) < DB_SNAPSHOT_INTERVAL) {
+        pthread_cond_wait(&checkpoint_cond, &checkpoint_mutex);
+    }
+
+    pthread_mutex_unlock(&checkpoint_mutex);
+}
+
+/**
+* Writes a snapshot of the log engine database and truncates the log. Changes to
+* the database wait until the snapshot is written. Returns 0 on success and -1 on
+* failure, in which case the log is kept
+*/
+int checkpoint_database() {
+    if (!engine->checkpoints)
+        return 0;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pthread_rwlock_wrlock(&state_lock);
+
+    unsigned long lsn = wal_last_lsn();
+    if (write_snapshot(lsn) != 0) {
+        pthread_rwlock_unlock(&state_lock);
+        LOG_ERROR("[DB] Failed writing database snapshot");
+        return -1;
+    }
+
+    // the records in the log are replaced by the snapshot
+    __atomic_store_n(&records_since_snapshot, 0, __ATOMIC_RELAXED);
+    if (wal_truncate() != 0) {
+        LOG_DEBUG("[DB] Failed truncating the log, its records will be skipped on startup");
+    }
+
+    pthread_rwlock_unlock(&state_lock);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    long elapsed_ms = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000;
+    LOG_VERBOSE("[DB] Wrote snapshot up to log record %lu in %ld ms", lsn, elapsed_ms);
+
+    return 0;
+}
+
+/**
+* Marks the bids of an auction that are kept in a snapshot, the last MAX_SHOWN_BIDS and the
+* best bid of every bidder. Returns the number of kept bids
+*/
+int mark_kept_bids(struct auction *auc, unsigned char *kept) {
+    int n_kept = 0;
+    marks_pass++;
+    // bids are sorted by value, so the first bid of a bidder seen from the end is their best
+    for (int i = auc->n_bids - 1; i >= 0; --i) {
+        int bidder = atoi(auc->bids[i].uid) % MAX_USERS;
+        kept[i] = i >= auc->n_bids - MAX_SHOWN_BIDS || bidder_marks[bidder] != marks_pass;
+        bidder_marks[bidder] = marks_pass;
+        n_kept += kept[i];
+    }
+
+    return n_kept;
+}
+
+/**
+* Writes a snapshot of the database up to log record `lsn`. The snapshot is
+* written to a temporary file which replaces the previous snapshot once it is in
+* disk, and the rename is made durable by syncing DB_ROOT, so the log can be
+* truncated. Returns 0 on success and -1 on failure
+*/
+int write_snapshot(unsigned long lsn) {
+    FILE *fp;
+    char tmp_path[64];
+    sprintf(tmp_path, "%s.tmp", DB_SNAPSHOT_FILE);
+    if ((fp = fopen(tmp_path, "w")) == NULL) {
+        LOG_ERROR("[DB] fopen: %s", strerror(errno));
+        return -1;
+    }
+
+    setvbuf(fp, NULL, _IOFBF, 1 << 20);
+
+    struct snapshot_header header;
+    memset(&header, 0, sizeof(struct snapshot_header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.lsn = lsn;
+    header.checksum = WAL_HASH_SEED;
+
+    // the header is rewritten once the rest of the snapshot is written
+    int failed = fwrite(&header, sizeof(struct snapshot_header), 1, fp) != 1;
+
+    for (long uid = 0; uid < MAX_USERS && !failed; ++uid) {
+        if (users[uid] == NULL)
+            continue;
+
+        struct snapshot_user entry;
+        memset(&entry, 0, sizeof(struct snapshot_user));
+        entry.uid = uid;
+        entry.registered = user_registered(uid);
+        entry.logged_in = user_logged_in(uid);
+        memcpy(entry.passwd, users[uid]->passwd, PASSWORD_SIZE + 1);
+        entry.n_hosted = users[uid]->hosted.n;
+        entry.n_bidded = users[uid]->bidded.n;
+
+        failed = fwrite(&entry, sizeof(struct snapshot_user), 1, fp) != 1;
+        header.checksum = wal_hash(&entry, sizeof(struct snapshot_user), header.checksum);
+        header.n_users++;
+    }
+
+    // auctions are written with the number of kept bids, which follow them
+    unsigned char **kept = calloc(auc_count + 1, sizeof(unsigned char *));
+    failed = failed || kept == NULL;
+    for (int aid = 1; aid <= auc_count && !failed; ++aid) {
+        struct auction entry = *auction_entry(aid);
+        if (entry.n_bids > 0) {
+            if ((kept[aid] = malloc(entry.n_bids)) == NULL) {
+                failed = 1;
+                break;
+            }
+
+            entry.n_bids = mark_kept_bids(auction_entry(aid), kept[aid]);
+        }
+
+        entry.bids = NULL;
+        entry.bids_size = 0;
+        memset(&entry.src, 0, sizeof(struct record_cache));
+
+        failed = fwrite(&entry, sizeof(struct auction), 1, fp) != 1;
+        header.checksum = wal_hash(&entry, sizeof(struct auction), header.checksum);
+        header.n_auctions++;
+    }
+
+    for (int aid = 1; aid <= auc_count && !failed; ++aid) {
+        struct auction *auc = auction_entry(aid);
+        for (int i = 0; i < auc->n_bids && !failed; ++i) {
+            if (!kept[aid][i])
+                continue;
+
+            failed = fwrite(&auc->bids[i], sizeof(struct bid), 1, fp) != 1;
+            header.checksum = wal_hash(&auc->bids[i], sizeof(struct bid), header.checksum);
+            header.n_bids++;
+        }
+    }
+
+    for (int aid = 1; kept != NULL && aid <= auc_count; ++aid)
+        free(kept[aid]);
+
+    free(kept);
+
+    // users are in the same order as above
+    for (long uid = 0; uid < MAX_USERS && !failed; ++uid) {
+        if (users[uid] == NULL)
+            continue;
+
+        struct aid_set *sets[2] = {&users[uid]->hosted, &users[uid]->bidded};
+        for (int i = 0; i < 2 && !failed; ++i) {
+            if (sets[i]->n == 0)
+                continue;
+
+            failed = fwrite(sets[i]->aids, sizeof(int), sets[i]->n, fp) != (size_t)sets[i]->n;
+            header.checksum = wal_hash(sets[i]->aids, sets[i]->n * sizeof(int), header.checksum);
+            header.n_user_aids += sets[i]->n;
+        }
+    }
+
+    if (!failed) {
+        failed = fseek(fp, 0, SEEK_SET) != 0 ||
+                    fwrite(&header, sizeof(struct snapshot_header), 1, fp) != 1 ||
+                    fflush(fp) != 0 || fsync(fileno(fp)) != 0;
+    }
+
+    if (fclose(fp) != 0 || failed) {
+        LOG_ERROR("[DB] Failed writing snapshot file %s", tmp_path);
+        LOG_ERROR("[DB] write: %s", strerror(errno));
+        remove(tmp_path);
+        return -1;
+    }
+
+    if (rename(tmp_path, DB_SNAPSHOT_FILE) != 0) {
+        LOG_ERROR("[DB] rename: %s", strerror(errno));
+        remove(tmp_path);
+        return -1;
+    }
+
+    // the working directory is DB_ROOT
+    int dir_fd;
+    if ((dir_fd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0 || fsync(dir_fd) != 0) {
+        LOG_ERROR("[DB] Failed syncing the snapshot's directory");
+        LOG_ERROR("[DB] fsync: %s", strerror(errno));
+        if (dir_fd >= 0)
+            close(dir_fd);
+        return -1;
+    }
+
+    close(dir_fd);
+
+    LOG_DEBUG("[DB] Snapshot has %ld users, %ld auctions and %ld bids", header.n_users, header.n_auctions, header.n_bids);
+
+    return 0;
+}
+
+/**
+* Loads the database state from the latest snapshot, if there is one, and sets
+* `lsn` to the last log record in it. Returns 0 on success and -1 if the snapshot
+* is corrupted
+*/
+int load_snapshot(unsigned long *lsn) {
+    *lsn = 0;
+
+    int fd;
+    if ((fd = open(DB_SNAPSHOT_FILE, O_RDONLY)) < 0) {
+        if (errno == ENOENT)
+            return 0;
+
+        LOG_ERROR("[DB] Failed opening snapshot %s", DB_SNAPSHOT_FILE);
+        LOG_ERROR("[DB] open: %s", strerror(errno));
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(struct snapshot_header)) {
+        LOG_ERROR("[DB] Snapshot %s is corrupted", DB_SNAPSHOT_FILE);
+        close(fd);
+        return -1;
+    }
+
+    size_t size = st.st_size;
+    char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        LOG_ERROR("[DB] mmap: %s", strerror(errno));
+        return -1;
+    }
+
+    madvise(map, size, MADV_SEQUENTIAL);
+
+    struct snapshot_header *header = (struct snapshot_header *)map;
+    struct snapshot_user *snap_users = (struct snapshot_user *)(map + sizeof(struct snapshot_header));
+    struct auction *snap_auctions = (struct auction *)(snap_users + header->n_users);
+    struct bid *snap_bids = (struct bid *)(snap_auctions + header->n_auctions);
+    int *snap_aids = (int *)(snap_bids + header->n_bids);
+
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+        header->n_users < 0 || header->n_users > MAX_USERS ||
+        header->n_auctions < 0 || header->n_auctions > max_auctions || header->n_bids < 0 ||
+        header->n_user_aids < 0 ||
+        size != sizeof(struct snapshot_header) + header->n_users * sizeof(struct snapshot_user) +
+                header->n_auctions * sizeof(struct auction) + header->n_bids * sizeof(struct bid) +
+                header->n_user_aids * sizeof(int) ||
+        header->checksum != wal_hash(snap_users, size - sizeof(struct snapshot_header), WAL_HASH_SEED)) {
+        LOG_ERROR("[DB] Snapshot %s is corrupted", DB_SNAPSHOT_FILE);
+        munmap(map, size);
+        return -1;
+    }
+
+    long n_aids = 0;
+    for (long i = 0; i < header->n_users; ++i) {
+        struct snapshot_user *entry = &snap_users[i];
+        long uid = entry->uid % MAX_USERS;
+        if (users[uid] == NULL && (users[uid] = calloc(1, sizeof(struct user))) == NULL) {
+            munmap(map, size);
+            return -1;
+        }
+
+        struct user *user = users[uid];
+        set_user_state(uid, entry->registered, entry->logged_in);
+        memcpy(user->passwd, entry->passwd, PASSWORD_SIZE + 1);
+
+        if (entry->n_hosted < 0 || entry->n_bidded < 0 ||
+            n_aids + entry->n_hosted + entry->n_bidded > header->n_user_aids) {
+            LOG_ERROR("[DB] Snapshot %s is corrupted", DB_SNAPSHOT_FILE);
+            munmap(map, size);
+            return -1;
+        }
+
+        // the sets were written sorted, so every AID is appended
+        for (int j = 0; j < entry->n_hosted; ++j)
+            aid_set_add(&user->hosted, snap_aids[n_aids++]);
+
+        for (int j = 0; j < entry->n_bidded; ++j)
+            aid_set_add(&user->bidded, snap_aids[n_aids++]);
+    }
+
+    long n_bids = 0;
+    for (long i = 0; i < header->n_auctions; ++i) {
+        struct auction *auc = alloc_auction_entry(i + 1);
+        if (auc == NULL) {
+            munmap(map, size);
+            return -1;
+        }
+
+        *auc = snap_auctions[i];
+        memset(&auc->src, 0, sizeof(struct record_cache));
+        if (auc->n_bids < 0 || n_bids + auc->n_bids > header->n_bids) {
+            LOG_ERROR("[DB] Snapshot %s is corrupted", DB_SNAPSHOT_FILE);
+            munmap(map, size);
+            return -1;
+        }
+
+        if (auc->n_bids > 0) {
+            if ((auc->bids = malloc(auc->n_bids * sizeof(struct bid))) == NULL) {
+                munmap(map, size);
+                return -1;
+            }
+
+            memcpy(auc->bids, snap_bids + n_bids, auc->n_bids * sizeof(struct bid));
+            auc->bids_size = auc->n_bids;
+            n_bids += auc->n_bids;
+        }
+    }
+
+    auc_count = header->n_auctions;
+    *lsn = header->lsn;
+
+    LOG_VERBOSE("[DB] Loaded snapshot with %ld users, %ld auctions and %ld bids up to log record %lu",
+                header->n_users, header->n_auctions, header->n_bids, header->lsn);
+
+    munmap(map, size);
+    return 0;
+}
+
+/**
+* Writes the state loaded from a snapshot in the directory layout. Returns 0 on
+* success and -1 on failure
+*/
+int export_snapshot() {
+    for (int uid = 0; uid < MAX_USERS; ++uid) {
+        struct user *user = users[uid];
+        if (user == NULL)
+            continue;
+
+        // registering a user also logs them in
+        char uid_str[16];
+        sprintf(uid_str, "%06d", uid);
+        if (fs_store_register(uid_str, user->passwd) != 0 ||
+            (!user_registered(uid) && fs_store_unregister(uid_str) != 0) ||
+            (user_registered(uid) && !user_logged_in(uid) && fs_store_logout(uid_str) != 0)) {
+            LOG_ERROR("[DB] Failed exporting user %s", uid_str);
+            return -1;
+        }
+    }
+
+    for (int aid = 1; aid <= auc_count; ++aid) {
+        struct auction *auc = auction_entry(aid);
+        if (fs_store_create_auction(aid) != 0 ||
+            fs_store_open(aid, auc->uid, auc->name, auc->fname, auc->start_value,
+                            auc->time_active, auc->start_datetime, auc->start_time) != 0) {
+            LOG_ERROR("[DB] Failed exporting auction %03d", aid);
+            return -1;
+        }
+
+        for (int i = 0; i < auc->n_bids; ++i) {
+            struct bid *cur = &auc->bids[i];
+            if (fs_store_bid(aid, cur->uid, cur->value, cur->datetime, cur->sec_time) != 0) {
+                LOG_ERROR("[DB] Failed exporting auction %03d bids", aid);
+                return -1;
+            }
+        }
+
+        if (auc->ended && fs_store_end(aid, auc->end_datetime, auc->end_sec_time) != 0) {
+            LOG_ERROR("[DB] Failed exporting auction %03d", aid);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+* Makes room in the expiry heap for one more auction. Returns 0 on success and
+* -1 on failure
+*/
+int expiry_heap_reserve() {
+    if (expiry_heap_size < expiry_heap_capacity)
+        return 0;
+
+    int capacity = expiry_heap_capacity == 0 ? 1024 : expiry_heap_capacity * 2;
+    struct deadline *heap = realloc(expiry_heap, capacity * sizeof(struct deadline));
+    if (heap == NULL) {
+        LOG_DEBUG("[DB] realloc: %s", strerror(errno));
+        return -1;
+    }
+
+    expiry_heap = heap;
+    expiry_heap_capacity = capacity;
+    return 0;
+}
+
+/**
+* Add an auction to the expiry heap. Returns 0 on success and -1 on failure
+*/
+int expiry_heap_push(long deadline, int aid) {
+    if (expiry_heap_reserve() != 0) {
+        LOG_ERROR("[DB] Failed scheduling the expiry of auction %03d", aid);
+        return -1;
+    }
+
+    int i = expiry_heap_size++;
+    // sift up
+    while (i > 0 && expiry_heap[(i - 1) / 2].deadline > deadline) {
+        expiry_heap[i] = expiry_heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+
+    expiry_heap[i].deadline = deadline;
+    expiry_heap[i].aid = aid;
+
+    return 0;
+}
+
+/**
+* Remove the auction with the earliest deadline from the expiry heap
+*/
+void expiry_heap_pop() {
+    struct deadline last = expiry_heap[--expiry_heap_size];
+    int i = 0;
+    // sift down
+    while (2 * i + 1 < expiry_heap_size) {
+        int child = 2 * i + 1;
+        if (child + 1 < expiry_heap_size && expiry_heap[child + 1].deadline < expiry_heap[child].deadline)
+            child++;
+
+        if (last.deadline <= expiry_heap[child].deadline)
+            break;
+
+        expiry_heap[i] = expiry_heap[child];
+        i = child;
+    }
+
+    expiry_heap[i] = last;
+}
+
+/**
+* Arms the expiry timer for the earliest deadline in the expiry heap, or disarms
+* it if the heap is empty. Must be called with the expiry lock held
+*/
+void arm_expiry_timer() {
+    struct itimerspec timer;
+    memset(&timer, 0, sizeof(timer));
+    if (expiry_heap_size > 0)
+        timer.it_value.tv_sec = expiry_heap[0].deadline;
+
+    if (timerfd_settime(expiry_timer_fd, TFD_TIMER_ABSTIME, &timer, NULL) != 0) {
+        LOG_ERROR("[DB] Failed arming the expiry timer");
+        LOG_ERROR("[DB] timerfd_settime: %s", strerror(errno));
+    }
+}
+
+/**
+* Blocks until the expiry timer goes off, at the earliest deadline of an active
+* auction
+*/
+void wait_expiry() {
+    uint64_t expirations;
+    if (read(expiry_timer_fd, &expirations, sizeof(expirations)) < 0) {
+        LOG_ERROR("[DB] Failed waiting for the expiry timer");
+        LOG_ERROR("[DB] read: %s", strerror(errno));
+        sleep(1);
+    }
+}
+
+/**
+* Closes the auctions whose deadline has passed and arms the expiry timer for the
+* next deadline. Only the auctions whose deadline has passed are visited.
+*/
+int close_expired_auctions() {
+    LOG_DEBUG("[DB] Closing expired auctions");
+
+    long curr_time = current_time();
+
+    /**
+    * Pop auctions from the expiry heap until one that hasn't expired is found
+    */
+    while (1) {
+        lock_db_mutex(DB_LOCK_EXPIRY, "expiry");
+        if (expiry_heap_size == 0 || expiry_heap[0].deadline > curr_time) {
+            arm_expiry_timer();
+            unlock_db_mutex(DB_LOCK_EXPIRY, "expiry");
+            break;
+        }
+
+        char aid[8];
+        sprintf(aid, "%03d", expiry_heap[0].aid);
+        expiry_heap_pop();
+
+        unlock_db_mutex(DB_LOCK_EXPIRY, "expiry");
+
+        lock_db_mutex(DB_LOCK_AUCTION, aid);
+
+        // auction was closed by its owner before the deadline, continue
+        struct auction *auc = get_auction(aid);
+        if (auc->ended) {
+            unlock_db_mutex(DB_LOCK_AUCTION, aid);
+            continue;
+        }
+
+        /**
+        * The auction ended at its deadline, after remaining active for its
+        * whole time active
+        */
+        struct wal_record rec;
+        init_record(&rec, WAL_EXPIRE, atoi(aid), NULL);
+        rec.time = auc->start_time + auc->time_active;
+        if (commit_record(&rec) != 0) {
+            LOG_DEBUG("[DB] Failed expiring auction %s", aid);
+            unlock_db_mutex(DB_LOCK_AUCTION, aid);
+            continue;
+        }
+
+        unlock_db_mutex(DB_LOCK_AUCTION, aid);
+    }
+
+    return 0;
+}
+
+/**
+* Check if user is registred in DB, without taking any lock
+*/
+int exists_user(char *uid) {
+    return user_registered(atoi(uid) % MAX_USERS);
+}
+
+/**
+* Checks if user is logged in, without taking any lock
+*/
+int is_user_logged_in(char *uid) {
+    return user_logged_in(atoi(uid) % MAX_USERS);
+}
+
+int user_registered(long uid) {
+    return (__atomic_load_n(&registered_bits[uid / USER_BITS], __ATOMIC_ACQUIRE) >> (uid % USER_BITS)) & 1;
+}
+
+int user_logged_in(long uid) {
+    return (__atomic_load_n(&logged_in_bits[uid / USER_BITS], __ATOMIC_ACQUIRE) >> (uid % USER_BITS)) & 1;
+}
+
+/**
+* Sets the registered and logged in bits of a user, in the order that keeps
+* every logged in user registered
+*/
+void set_user_state(long uid, int registered, int logged_in) {
+    unsigned long mask = 1UL << (uid % USER_BITS);
+    if (registered)
+        __atomic_fetch_or(&registered_bits[uid / USER_BITS], mask, __ATOMIC_RELEASE);
+
+    if (logged_in)
+        __atomic_fetch_or(&logged_in_bits[uid / USER_BITS], mask, __ATOMIC_RELEASE);
+    else
+        __atomic_fetch_and(&logged_in_bits[uid / USER_BITS], ~mask, __ATOMIC_RELEASE);
+
+    if (!registered)
+        __atomic_fetch_and(&registered_bits[uid / USER_BITS], ~mask, __ATOMIC_RELEASE);
+}
+
+/**
+* Check if an auction exists in the database, looking it up in the auction table
+*/
+int exists_auction(char *aid) {
+    struct auction *auc = get_auction(aid);
+    return auc != NULL && auc->loaded;
+}
+
+int is_auction_finished(char *aid) {
+    lock_db_mutex(DB_LOCK_AUCTION, aid);
+
+    struct auction *auc = get_auction(aid);
+    int ret = auc != NULL && auc->ended;
+
+    unlock_db_mutex(DB_LOCK_AUCTION, aid);
+    return ret;
+}
+
+/**
+* Writes the auction information into buff in the same format as its START file
+*/
+int get_auction_info(char *aid, char *buff, int n) {
+    lock_db_mutex(DB_LOCK_AUCTION, aid);
+
+    struct auction *auc = get_auction(aid);
+    if (auc == NULL || !auc->loaded) {
+        LOG_DEBUG("[DB] Failed reading from auction %s information, database might be corrupted", aid);
+        unlock_db_mutex(DB_LOCK_AUCTION, aid);
+        return 1;
+    }
+
+    snprintf(buff, n, "%s %s %s %d %d %s %ld\n", auc->uid, auc->name, auc->fname,
+                auc->start_value, auc->time_active, auc->start_datetime, auc->start_time);
+
+    unlock_db_mutex(DB_LOCK_AUCTION, aid);
+
+    return 0;
+}
+
+/**
+* Copies the cached SRC response of an auction into the size bytes of buff, if the
+* auction didn't change since it was rendered. Returns its length, or 0 if it has
+* to be rendered again from the version of the auction written to *version
+*/
+int get_cached_auction_record(char *aid, char *buff, int size, unsigned long *version) {
+    lock_db_mutex(DB_LOCK_AUCTION, aid);
+
+    int len = 0;
+    struct auction *auc = get_auction(aid);
+    if (auc != NULL) {
+        struct record_cache *cache = &auc->src;
+        if (cache->response != NULL && cache->version == auc->version && cache->len <= size) {
+            memcpy(buff, cache->response, cache->len);
+            len = cache->len;
+            __atomic_add_fetch(&cache->hits, 1, __ATOMIC_RELAXED);
+        } else {
+            __atomic_add_fetch(&cache->misses, 1, __ATOMIC_RELAXED);
+        }
+
+        *version = auc->version;
+    }
+
+    unlock_db_mutex(DB_LOCK_AUCTION, aid);
+    return len;
+}
+
+/**
+* Caches the SRC response of an auction rendered from its `version`, unless the
+* auction changed while it was rendered. A response that doesn't fit in its
+* buffer is only cached while the buffers of every auction take no more than
+* SRC_CACHE_MAX_BYTES, otherwise the stale one is dropped
+*/
+void cache_auction_record(char *aid, unsigned long version, char *response, int len) {
+    lock_db_mutex(DB_LOCK_AUCTION, aid);
+
+    struct auction *auc = get_auction(aid);
+    if (auc != NULL && auc->version == version) {
+        struct record_cache *cache = &auc->src;
+        if (cache->size < len) {
+            long grow = len - cache->size;
+            char *buff = NULL;
+            if (__atomic_add_fetch(&src_cache_bytes, grow, __ATOMIC_RELAXED) > SRC_CACHE_MAX_BYTES ||
+                (buff = realloc(cache->response, len)) == NULL) {
+                __atomic_sub_fetch(&src_cache_bytes, grow, __ATOMIC_RELAXED);
+                drop_cached_auction_record(cache);
+            } else {
+                cache->response = buff;
+                cache->size = len;
+            }
+        }
+
+        if (cache->size >= len) {
+            memcpy(cache->response, response, len);
+            cache->len = len;
+            cache->version = version;
+        }
+    }
+
+    unlock_db_mutex(DB_LOCK_AUCTION, aid);
+}
+
+/**
+* Frees the SRC response cached for an auction, must be called with the auction's
+* lock held
+*/
+void drop_cached_auction_record(struct record_cache *cache) {
+    __atomic_sub_fetch(&src_cache_bytes, cache->size, __ATOMIC_RELAXED);
+    free(cache->response);
+    cache->response = NULL;
+    cache->len = 0;
+    cache->size = 0;
+}
+
+/**
+* Writes the auctions hosted by a user, ended by '\n', into the size bytes of
+* buff. Returns the number of bytes written, the result isn't NUL terminated
+*/
+int get_user_auctions(char *uid, char *buff, int size) {
+    int written = 0;
+
+    lock_db_mutex(DB_LOCK_USER, uid);
+
+    struct user *user = get_user(uid);
+    if (user != NULL)
+        written = write_aid_set(&user->hosted, buff, size);
+
+    unlock_db_mutex(DB_LOCK_USER, uid);
+
+    buff[written++] = '\n';
+    return written;
+}
+
+/**
+* Writes " AID state" for every auction, ended by '\n', into the size bytes of
+* buff. Returns the number of bytes written, the result isn't NUL terminated
+*/
+int get_auctions_list(char *buff, int size) {
+    /** Iterate all auctions, only the last MAX_LISTED_AUCTIONS fit in a datagram */
+    int written = 0;
+    int count = get_auction_count();
+    int first = count > MAX_LISTED_AUCTIONS ? count - MAX_LISTED_AUCTIONS + 1 : 1;
+    for (int aid = first; aid <= count; aid++) {
+        // " AID state", state is 0 if the auction has ended
+        int ended = __atomic_load_n(&auction_entry(aid)->ended, __ATOMIC_ACQUIRE);
+        int n = snprintf(buff + written, size - written, " %03d %d", aid, !ended);
+        if (n >= size - written - 1)
+            break;
+
+        written += n;
+    }
+
+    buff[written++] = '\n';
+    return written;
+}
 
-        // last field, seconds passed from auction start until bid was made
-        char *bid_sec_time = strtok(NULL, "\n");
-        if (bid_sec_time == NULL) {
-            LOG_DEBUG("Got not bid sec time");
-            free(entries[i]);
-            continue;
-        }
+/**
+* Writes the bids of an auction shown by SRC, and its end if it has ended, ended
+* by '\n', into the size bytes of buff. Returns the number of bytes written, the
+* result isn't NUL terminated
+*/
+int get_auction_bidders_list(char *aid, char *buff, int size) {
+    lock_db_mutex(DB_LOCK_AUCTION, aid);
 
-        // retrieve bid value from file name, file name in format VVVVVV.txt
-        int bid_value;
-        if ((sscanf(entries[i]->d_name, "%d.txt", &bid_value)) != 1) {
-            LOG_DEBUG("Invalid bid value");
-            free(entries[i]);
-            continue;
-        }
+    struct auction *auc = get_auction(aid);
 
-        char bid_entry[128] = {0};
-        // write entry to response { B host_UID bid_value bid_date-time bid_sec_time }
-        sprintf(bid_entry, " B %.6s %d %s %s %s", bidder_uid, bid_value, bid_date, bid_time, bid_sec_time);
-        strcat(buff, bid_entry);
-        written += strlen(bid_entry);
+    // the ring holds the biggest bids, from the oldest to the last
+    int written = 0;
+    int first_bid = auc == NULL || auc->n_placed <= MAX_SHOWN_BIDS ? 0 : auc->n_placed - MAX_SHOWN_BIDS;
+    for (int i = first_bid; auc != NULL && i < auc->n_placed; ++i) {
+        struct bid *cur = &auc->recent_bids[i % MAX_SHOWN_BIDS];
+        int n = snprintf(buff + written, size - written, " B %s %d %s %ld",
+                            cur->uid, cur->value, cur->datetime, cur->sec_time);
+        if (n >= size - written - 1)
+            break;
 
-        free(entries[i]);
+        written += n;
     }
 
-    // free non interated bids
-    for (int i = 2; i < first_entry; ++i)
-        free(entries[i]);
-
-    free(entries);
-    
     /**
     * Check if auction has ended
     */
-    FILE *fp;
-    char end_path[32];
-    char end_info[128] = {0};
-    sprintf(end_path, "AUCTIONS/%.3s/END_%.3s.txt", aid, aid);
-    if ((fp = fopen(end_path, "r")) != NULL) {
-        // retrieve bid END information
-        char end_buff[128];
-        if (fgets(end_buff, 128, fp) != NULL) {
-            char *date = strtok(end_buff, " ");
-            char *time = strtok(NULL, " ");
-            char *end_sec_time = strtok(NULL, "\n");
-
-            // this was the last part of the code written for the entire thing, the fatigue is palpable
-            if (date != NULL && time != NULL && end_sec_time != NULL) {
-                if (is_valid_date_time(date, time)) {
-                    sprintf(end_info, " E %s %s %s", date, time, end_sec_time);
-                    written += strlen(end_info);
-
-                }
-            }
-        }
-        fclose(fp);
+    if (auc != NULL && auc->ended && auc->end_datetime[0] != '\0') {
+        int n = snprintf(buff + written, size - written, " E %s %ld", auc->end_datetime, auc->end_sec_time);
+        if (n < size - written - 1)
+            written += n;
     }
-    
-    strcat(buff, end_info);
-    strcat(buff, "\n");
-    written += 1;
 
-    unlock_db_mutex("bidders list");
+    buff[written++] = '\n';
+
+    unlock_db_mutex(DB_LOCK_AUCTION, aid);
     return written;
 }
 
 /**
-* Logs in the user with uid. Returns 0 on success and -1 on failure
+* Logs in the user with uid, if it isn't logged in yet, so the FS engine never
+* writes the same login twice. Returns 0 on success and -1 on failure
 */
 int log_in_user(char *uid) {
-    lock_db_mutex(uid);
+    struct wal_record rec;
+    init_record(&rec, WAL_LOGIN, 0, uid);
 
-    int fd;
-    char user_login_path[32];
-    sprintf(user_login_path, "USERS/%6s/%6s_login.txt", uid, uid);
-    if ((fd = open(user_login_path, O_CREAT, SERVER_MODE)) == -1) {
-        LOG_DEBUG("[DB] Couldn't create login file for user %s", uid);
-        unlock_db_mutex(uid);
-        return -1;
+    lock_db_mutex(DB_LOCK_USER, uid);
+
+    // requests checked the login without the lock, another one may have won
+    if (is_user_logged_in(uid)) {
+        unlock_db_mutex(DB_LOCK_USER, uid);
+        return 0;
     }
 
-    if (close(fd) != 0) {
-        LOG_DEBUG("[DB] Failed closing file descriptor, resources might be leaking");
-        LOG_DEBUG("[DB] close: %s", strerror(errno));
-    };
+    if (commit_record(&rec) != 0) {
+        LOG_DEBUG("[DB] Couldn't log in user %s", uid);
+        unlock_db_mutex(DB_LOCK_USER, uid);
+        return -1;
+    }
 
-    unlock_db_mutex(uid);
-    return 0;
+    unlock_db_mutex(DB_LOCK_USER, uid);
+    return sync_record(&rec);
 }
 
 int log_out_user(char *uid) {
-    lock_db_mutex(uid);
-
-    char user_login_path[32];
-    sprintf(user_login_path, "USERS/%.6s/%.6s_login.txt", uid, uid);
-    if (remove(user_login_path) != 0) {
-        LOG_DEBUG("[DB] Failed removing login file %s", uid);
-        LOG_DEBUG("[DB] remove: %s", strerror(errno));
-        unlock_db_mutex(uid);
+    struct wal_record rec;
+    init_record(&rec, WAL_LOGOUT, 0, uid);
+
+    lock_db_mutex(DB_LOCK_USER, uid);
+
+    // requests checked the login without the lock, another one may have won
+    if (!is_user_logged_in(uid)) {
+        unlock_db_mutex(DB_LOCK_USER, uid);
+        return 0;
+    }
+
+    if (commit_record(&rec) != 0) {
+        LOG_DEBUG("[DB] Couldn't log out user %s", uid);
+        unlock_db_mutex(DB_LOCK_USER, uid);
         return -1;
     }
 
-    unlock_db_mutex(uid);
-    return 0;
+    unlock_db_mutex(DB_LOCK_USER, uid);
+    return sync_record(&rec);
 }
 
 /**
 * Creates a user in the DB. Returns 0 on success and -1 on failure
 */
 int register_user(char *uid, char *passwd) {
-    lock_db_mutex(uid);
-    
-    // create user directory (e.g root/USERS/123456)
-    char user_file_path[32];
-    sprintf(user_file_path, "USERS/%.6s", uid);
-    if (mkdir(user_file_path, SERVER_MODE) != 0) {
-        if (errno != EEXIST) {
-            LOG_DEBUG("[DB] Couldn't create user directory for user %s", uid);
-            LOG_DEBUG("[DB] mkdir: %s", strerror(errno));
-            unlock_db_mutex(uid);
-            return -1;
-        }
-    }
-    
-    // create user's HOSTED dir
-    sprintf(user_file_path, "USERS/%.6s/HOSTED", uid);
-    if (mkdir(user_file_path, SERVER_MODE) != 0) {
-        if (errno != EEXIST) {
-            LOG_DEBUG("[DB] Couldn't create HOSTED directory for user %s", uid);
-            LOG_DEBUG("[DB] mkdir: %s", strerror(errno));
-            unlock_db_mutex(uid);
-            return -1;
-        }
-    }
-    
-    // create user's BIDDED dir
-    sprintf(user_file_path, "USERS/%6s/BIDDED", uid);
-    if (mkdir(user_file_path, SERVER_MODE) != 0) {
-        if (errno != EEXIST) {
-            LOG_DEBUG("[DB] Couldn't create BIDDED directory for user %s", uid);
-            LOG_DEBUG("[DB] mkdir: %s", strerror(errno));
-            unlock_db_mutex(uid);
-            return -1;
-        }
-    }
-
-       // mark user as logged in (e.g touch root/USERS/123456/123456_login.txt)
-    int login_fd;
-    sprintf(user_file_path, "USERS/%6s/%6s_login.txt", uid, uid);
-    if ((login_fd = open(user_file_path, O_CREAT, SERVER_MODE)) < 0) {
-        LOG_DEBUG("[DB] Couldn't create login file for user %6s", uid);
-        LOG_DEBUG("[DB] open: %s", strerror(errno));
-        unlock_db_mutex(uid);
-        return -1;
-    }
-
-    if (close(login_fd) != 0) {
-        LOG_DEBUG("[DB] Failed closing file descriptor, resources might be leaking");
-        LOG_DEBUG("[DB] close: %s", strerror(errno));
-    };
-
-    // create user password file (e.g root/USERS/123456/123456_pass.txt)
-    sprintf(user_file_path, "USERS/%6s/%6s_pass.txt", uid, uid);
-    int pass_fd;
-    if ((pass_fd = open(user_file_path, O_CREAT | O_WRONLY, SERVER_MODE)) < 0) {
-        LOG_ERROR("[DB] open: %s", strerror(errno));
-        LOG_DEBUG("[DB] Couldn't create user password file for user %s", uid);
-        unlock_db_mutex(uid);
-        return -1;
-    }
-
-    // write password
-    if (write(pass_fd, passwd, 8) != 8) {
-        LOG_DEBUG("[DB] Couldn't write password for user %s", uid);
-        LOG_ERROR("[DB] write: %s", strerror(errno));
-        if (remove(user_file_path) != 0) {
-            LOG_DEBUG("[DB] Failed removing %s_pass.txt after failure registering user, a ghost user %s now exists", uid, uid);
-        }
+    struct wal_record rec;
+    init_record(&rec, WAL_REGISTER, 0, uid);
+    strncpy(rec.passwd, passwd, PASSWORD_SIZE);
 
-        if (close(pass_fd) != 0) {
-            LOG_DEBUG("[DB] Failed closing file descriptor, resources might be leaking");
-            LOG_DEBUG("[DB] close: %s", strerror(errno));
-        }
+    lock_db_mutex(DB_LOCK_USER, uid);
 
-        unlock_db_mutex(uid);
+    if (commit_record(&rec) != 0) {
+        LOG_DEBUG("[DB] Couldn't register user %s", uid);
+        unlock_db_mutex(DB_LOCK_USER, uid);
         return -1;
     }
- 
-    if (close(pass_fd) != 0) {
-        LOG_DEBUG("[DB] Failed closing file descriptor, resources might be leaking");
-        LOG_DEBUG("[DB] close: %s", strerror(errno));
-    };
 
-    unlock_db_mutex(uid);
-    return 0;
+    unlock_db_mutex(DB_LOCK_USER, uid);
+    return sync_record(&rec);
 }
 
 /**
 * Unregister a user. Returns 0 on success and -1 on failure, which may screw the
 * user's bids and hosted auctions. It would take way too much work to use tmp files for this, also,
-* databases are so complex to implement we simply assume it's not necessary for 
+* databases are so complex to implement we simply assume it's not necessary for
 * this project
 */
 int unregister_user(char *uid) {
-    lock_db_mutex(uid);
-
-    // remove user's login
-    char user_file_path[32];
-    sprintf(user_file_path, "USERS/%6s/%6s_login.txt", uid, uid);
-    if (remove(user_file_path) != 0) {
-        LOG_DEBUG("[DB] Failed removing login file for user %s", uid);
-        LOG_DEBUG("[DB] remove: %s", strerror(errno));
-        unlock_db_mutex(uid);
-        return -1;
-    }
+    struct wal_record rec;
+    init_record(&rec, WAL_UNREGISTER, 0, uid);
 
-    // remove user's passwd
-    sprintf(user_file_path, "USERS/%.6s/%.6s_pass.txt", uid, uid);
-    if (remove(user_file_path) != 0) {
-        LOG_DEBUG("[DB] Failed removing password file for user %s", uid);
-        LOG_DEBUG("[DB] remove: %s", uid);
-        unlock_db_mutex(uid);
+    lock_db_mutex(DB_LOCK_USER, uid);
+
+    if (commit_record(&rec) != 0) {
+        LOG_DEBUG("[DB] Couldn't unregister user %s", uid);
+        unlock_db_mutex(DB_LOCK_USER, uid);
         return -1;
     }
 
-    unlock_db_mutex(uid);
-    return 0;
+    unlock_db_mutex(DB_LOCK_USER, uid);
+    return sync_record(&rec);
 }
 
 /**
 * Returns 1 if provided password matches the password stored for user with uid
 */
 int is_authentic_user(char *uid, char *passwd) {
-    lock_db_mutex(uid);
-
-    FILE *fp;
-    char passwd_path_file[32];
-    char stored_password[16];
-    sprintf(passwd_path_file, "USERS/%.6s/%.6s_pass.txt", uid, uid);
-    if ((fp = fopen(passwd_path_file, "r")) == NULL) {
-        unlock_db_mutex(uid);
-        return 0;
-    }
-
-    if (fgets(stored_password, 16, fp) == NULL) {
-        fclose(fp);
-        unlock_db_mutex(uid);
-        return -1;
-    }
-
-    fclose(fp);
+    lock_db_mutex(DB_LOCK_USER, uid);
 
-    int r = strcmp(stored_password, passwd) == 0 ? 1 : 0;
+    struct user *user = get_user(uid);
+    int r = user != NULL && exists_user(uid) && strcmp(user->passwd, passwd) == 0;
 
-    unlock_db_mutex(uid);
+    unlock_db_mutex(DB_LOCK_USER, uid);
     return r;
 }
 
 /**
-* Creates a new auction and returns it's AID if successfull. On failure returns -1
+* Checks that a user is registered and logged in and that `passwd` is theirs,
+* must be called with the user's lock held
 */
-int create_auction_dir() { 
-    // if we reached the limit auctions
-    if (auc_count >= 999) {
-        return -1;
-    }
-
-    auc_count++;
-
-    char tmp_path[32];
-    // create auction directory    
-    sprintf(tmp_path, "AUCTIONS/%03d", auc_count);
-    if (mkdir(tmp_path, SERVER_MODE) != 0) {
-        if (errno != EEXIST) {
-            LOG_DEBUG("[DB] Failed creating new auction %s", tmp_path);
-            LOG_DEBUG("[DB] mkdir: %s", strerror(errno));
-            return -1;
-        }
-    }
-
-    // create BIDS folder inside dir
-    sprintf(tmp_path, "AUCTIONS/%03d/BIDS", auc_count);
-    if (mkdir(tmp_path, SERVER_MODE) != 0) {
-        if (errno != EEXIST) {
-            LOG_DEBUG("[DB] Failed creating BIDS folder for auction %s", tmp_path);
-            LOG_DEBUG("[DB] mkdir: %s", strerror(errno));
-            return -1;
-        }
-    }
+db_status_t check_user(char *uid, char *passwd) {
+    struct user *user = get_user(uid);
+    if (user == NULL || !exists_user(uid))
+        return DB_NO_USER;
 
-    // create BIDS folder inside dir
-    sprintf(tmp_path, "AUCTIONS/%03d/ASSET", auc_count);
-    if (mkdir(tmp_path, SERVER_MODE) != 0) {
-        if (errno != EEXIST) {
-            LOG_DEBUG("[DB] Failed creating ASSET folder for auction %s", tmp_path);
-            LOG_DEBUG("[DB] mkdir: %s", strerror(errno));
-            return -1;
-        }
-    }
+    if (!is_user_logged_in(uid) || strcmp(user->passwd, passwd) != 0)
+        return DB_NOT_LOGGED_IN;
 
-    return auc_count;
+    return DB_OK;
 }
 
 /**
-* Rolls back an auction directory creation that went wrong. This prevents 
-* ghost auctions from being accumulated in the database
+* Checks that an auction exists and is still active, must be called with the
+* auction's lock held. Auctions past their deadline count as ended even if the
+* closer thread didn't close them yet
 */
-void rollback_auction_dir_creation() {
-    DIR *dp;
-    struct dirent *cur;
-
-    // directory for auction doesn't exist (creation failed because max limit was exceeded)
-    char auction_file_path[32];
-    sprintf(auction_file_path, "AUCTIONS/%03d", auc_count);
-    if ((dp = opendir(auction_file_path)) == NULL) {
-        if (errno == ENOENT) { // directory doesn't exist
-            LOG_DEBUG("[DB] Dir doesn't exist / wasn't created (%s)", auction_file_path);
-        } else {
-            LOG_DEBUG("[DB] Failed opening %03d auction directory on rollback action, database might be corrupted", auc_count);
-            LOG_DEBUG("[DB] open: %s", strerror(errno));
-        }
-        return;
-    }
-
-    char file_path[512]; // it's this big because any file can actually be placed there (even if statement prohibits this fname size)
-                        // and we must avoid buffer overflows
-    // remove all regular files inside directory
-    while ((cur = readdir(dp)) != NULL) {
-        if (cur->d_name[0] == '.') continue;
-
-        // remove all files
-        if (cur->d_type == DT_REG) {
-            sprintf(file_path, "AUCTIONS/%03d/%s", auc_count, cur->d_name);
-            if (remove(file_path) != 0) {
-                LOG_DEBUG("[DB] Couldn't remove file %s on rollback action, database might be corrupted", cur->d_name);
-                LOG_DEBUG("[DB] remove: %s", strerror(errno));
-            }
-        }
-    }
-
-    if (closedir(dp) != 0) {
-        LOG_DEBUG("[DB] Failed closing file descriptor, resources may be leaking");
-        LOG_DEBUG("[DB] closedir: %s", strerror(errno));
-    };
-
-    // remove bids if they exist
-    char bids_dir[32];
-    char bid_file_path[512]; // this because becuase of same reason as `file_path`
-    sprintf(bids_dir, "AUCTIONS/%03d/BIDS", auc_count);
-    if ((dp = opendir(bids_dir)) != NULL) {
-        while ((cur = readdir(dp)) != NULL) {
-            if (cur->d_name[0] == '.') continue;
-
-            if (cur->d_type == DT_REG) {
-                sprintf(bid_file_path, "AUCTIONS/%03d/BIDS/%s", auc_count, cur->d_name);
-                if (remove(bid_file_path) != 0) {
-                    LOG_DEBUG("[DB] Couldn't remove bid file %s on rollback action, database might be corrupted", cur->d_name);
-                    LOG_ERROR("[DB] remove: %s", strerror(errno));
-                }
-            }
-
-        }
-
-        if (closedir(dp) != 0) {
-            LOG_DEBUG("[DB] Failed closing file descriptor, resources may be leaking");
-            LOG_DEBUG("[DB] closedir: %s", strerror(errno));
-        };
-
-        // remove directory
-        if ((remove(bids_dir) != 0)) {
-            LOG_DEBUG("[DB] Failed removing BIDS directory on rollback action, a ghost auction now exists");
-            LOG_DEBUG("[DB] remove: %s", strerror(errno));
-        }
-    }
-
-    // remove files in ASSET folder
-    char asset_dir[32];
-    char asset_file_path[512]; // this big because of the same reason as `file_path`
-    sprintf(asset_dir, "AUCTIONS/%03d/ASSET", auc_count);
-    if ((dp = opendir(asset_dir)) != NULL) {
-        while ((cur = readdir(dp)) != NULL) {
-            if (cur->d_name[0] == '.') continue;
-
-            if (cur->d_type == DT_REG) {
-                sprintf(asset_file_path, "AUCTIONS/%03d/ASSET/%s", auc_count, cur->d_name);
-                if (remove(asset_file_path) != 0) {
-                    LOG_DEBUG("[DB] Couldn't remove bid file %s on rollback action, database might be corrupted", cur->d_name);
-                    LOG_DEBUG("[DB] remove: %s", strerror(errno));
-                }
-            }
-        }
-
-        if (closedir(dp) != 0) {
-            LOG_DEBUG("[DB] Failed closing file descriptor, resources may be leaking");
-            LOG_DEBUG("[DB] closedir: %s", strerror(errno));
-        }
+db_status_t check_auction(struct auction *auc, char *aid) {
+    if (auc == NULL)
+        return DB_NO_AUCTION;
 
-        if ((remove(asset_dir) != 0)) {
-            LOG_DEBUG("[DB] Failed removing ASSET directory on rollback action, a ghost auction now exists");
-            LOG_DEBUG("[DB] remove: %s", strerror(errno));
-        }
+    if (!auc->loaded) {
+        LOG_DEBUG("[DB] Failed reading from auction %s information, databsae might be corrupted", aid);
+        return DB_FAILED;
     }
 
-    // remove directory
-    if ((remove(auction_file_path) != 0)) {
-        LOG_DEBUG("[DB] Failed removing directory on rollback action, a ghost auction now exists");
-        LOG_DEBUG("[DB] remove: %s", strerror(errno));
-    }
- 
-    auc_count--;
+    if (auc->ended || current_time() >= auc->start_time + auc->time_active)
+        return DB_AUCTION_ENDED;
 
-    return;
+    return DB_OK;
 }
 
-
 /**
-* Opens an auction in the database. 
+* Opens an auction in the database, storing its AID in `aid`.
 * This funciton handles the logic of creating an auction in the database and also
-* downloads the asset into the auction.
+* downloads the asset into the auction. The host is checked before the asset is
+* received and again when the auction is committed. The asset is received into
+* DB_STAGING_DIR and only moved into the auction once it has an AID
 */
-int create_new_auction(char *uid, char *name, char *fname, int sv, int ta, int fsize, int conn_fd) {
-    lock_db_mutex("create_auction");
-
-    int auc_id;
-    if ((auc_id = create_auction_dir()) < 0) {
-        unlock_db_mutex("create_auction");
-        return -1;
-    }
-
-    // create START_AID.txt file
-    char tmp_path[64];
-    sprintf(tmp_path, "AUCTIONS/%03d/START_%03d.txt", auc_count, auc_count);
-    int sfd;
-    if ((sfd = open(tmp_path, O_CREAT | O_WRONLY, SERVER_MODE)) < 0) {
-        LOG_DEBUG("open: %s", strerror(errno));
-        rollback_auction_dir_creation();
-        unlock_db_mutex("create_auction");
-        return -1;
-    }
-
-    if (close(sfd) != 0) {
-        LOG_DEBUG("[DB] Failed closing file descriptor, resources may be leaking");
-        LOG_DEBUG("close: %s", strerror(errno));
-    };
-
-    /**
-    * Process auction information
-    */
-    // auction start time
-    time_t unix_start_time;
-    if ((unix_start_time = time(NULL)) == ((time_t ) - 1)) {
-        LOG_DEBUG("[DB] Failed getting UNIX timestamp");
-        LOG_DEBUG("[DB] time: %s", strerror(errno));
-        rollback_auction_dir_creation();
-        unlock_db_mutex("create_auction");
-        return -1;
-    }
-
-    // auction start datetime
-    struct tm *tm_time;
-    if ((tm_time = gmtime(&unix_start_time)) == NULL) {
-        LOG_DEBUG("[DB] Failed getting datetime");
-        rollback_auction_dir_creation();
-        unlock_db_mutex("create_auction");
-        return -1;
-    }
-
-    char str_time[128];
-    sprintf(str_time, "%4d-%02d-%02d %02d:%02d:%02d", 
-                        tm_time->tm_year + 1900, tm_time->tm_mon + 1, tm_time->tm_mday,
-                        tm_time->tm_hour, tm_time->tm_min, tm_time->tm_sec);
-
-
-    char start_info[256];
-    sprintf(start_info, "%s %s %s %d %d %s %ld\n", 
-                            uid, name, fname, sv, ta, str_time, unix_start_time);
-
-    /**
-    * Write auction information
-    */
-    FILE *fp;
-    if ((fp = fopen(tmp_path, "w")) == NULL) {
-        rollback_auction_dir_creation();
-        unlock_db_mutex("create_auction");
-        return -1;
-    }
+db_status_t db_open_auction(char *uid, char *passwd, char *name, char *fname, int sv, int ta,
+                                int fsize, int conn_fd, int *aid) {
+    lock_db_mutex(DB_LOCK_USER, uid);
+    db_status_t status = check_user(uid, passwd);
+    unlock_db_mutex(DB_LOCK_USER, uid);
 
-    if (fputs(start_info, fp) < 0) {
-        fclose(fp);
-        rollback_auction_dir_creation();
-        unlock_db_mutex("create_auction");
-        return -1;
-    }
-
-    fclose(fp);
+    if (status != DB_OK)
+        return status;
 
     /**
-    * Retrieve auction asset file
+    * Receive the asset into a staging file, without any lock held, so slow
+    * uploads don't hold back other requests
     */
-    char asset_fname_path[64];
-    sprintf(asset_fname_path, "AUCTIONS/%03d/ASSET/%.*s", auc_count, FNAME_LEN, fname);
+    char staging_path[32];
+    sprintf(staging_path, "%s/asset_XXXXXX", DB_STAGING_DIR);
     int afd;
-    if ((afd = open(asset_fname_path, O_CREAT | O_WRONLY, SERVER_MODE)) < 0) {
-        LOG_DEBUG("[DB] open: %s", strerror(errno));
-        rollback_auction_dir_creation();
-        unlock_db_mutex("create_auction");
-        return -1;
+    if ((afd = mkstemp(staging_path)) < 0) {
+        LOG_DEBUG("[DB] mkstemp: %s", strerror(errno));
+        return DB_FAILED;
     }
 
-    /**
-    * Read asset content from socket
-    */
     if (as_recv_asset_file(afd, conn_fd, fsize) != 0) {
         LOG_DEBUG("[DB] Failed receiving assetfile when creating new auction ")
         close(afd);
-        rollback_auction_dir_creation();
-        unlock_db_mutex("create_auction");
-        return -1;
+        remove(staging_path);
+        return DB_FAILED;
     }
 
-    // Write last block without the \n 
+    // Write last block without the \n
     if (close(afd) != 0) {
         LOG_DEBUG("[DB] Failed closing file descriptor, resources may be leaking");
         LOG_DEBUG("[DB] close: %s", strerror(errno));
     };
 
-    /**
-    * Register user auction
-    */
-    sprintf(tmp_path, "USERS/%6s/HOSTED/%03d.txt", uid, auc_id);
-    int tmp_fd;
-    if ((tmp_fd = open(tmp_path, O_CREAT | O_WRONLY, SERVER_MODE)) < 0) {
-        LOG_DEBUG("[DB] open: %s", strerror(errno));
-        rollback_auction_dir_creation();
-        unlock_db_mutex("create_auction");
-        return -1;
-    }
-
-    if (close(tmp_fd) != 0) {
-        LOG_DEBUG("[DB] Failed closing file descriptor, resources may be leaking");
-        LOG_DEBUG("[DB] close: %s", strerror(errno));
-    };
-
-    unlock_db_mutex("create_auction");
-    return auc_id;
-}
-
-int close_auction(char *aid) {
-    lock_db_mutex(aid);
-    
-    FILE *fp;
-    char auction_path[128];
-    sprintf(auction_path, "AUCTIONS/%3s/START_%3s.txt", aid, aid);
-    if ((fp = fopen(auction_path, "r")) == NULL) {
-        LOG_DEBUG("[DB] Failed reading from auction %s information file, databsae might be corrupted", aid);
-        unlock_db_mutex(aid);
-        return 1;
-    }
-
-    char auction_info[256];
-    if (fgets(auction_info, 128, fp) == NULL) {
-        LOG_DEBUG("[DB] Failed reading from auction %s information file, database might be corrupted", aid);
-        fclose(fp);
-        unlock_db_mutex(aid);
-        return 1;
-    };
-
-    fclose(fp);
+    lock_db_mutex(DB_LOCK_CATALOG, "create_auction");
 
-    /**
-    * Calculate the time the auction remained active
-    */
-    // read last entry in START file (the start unix timestamp of the auction)
-    char *start_time = strtok(auction_info, " ");
-    for (int i = 0; i < 6; ++i) {
-        start_time = strtok(NULL, " ");
+    // if we reached the limit auctions
+    if (auc_count >= max_auctions) {
+        unlock_db_mutex(DB_LOCK_CATALOG, "create_auction");
+        remove(staging_path);
+        return DB_FAILED;
     }
 
-    start_time = strtok(NULL, "\n");
-
-    if (start_time == NULL) {
-        LOG_DEBUG("[DB] Got a badly formatted START_%3s file", aid );
-        unlock_db_mutex(aid);
-        return -1;
+    // the auction only becomes visible once it is published in the auction table
+    int auc_id = auc_count + 1;
+    if (fs_store_create_auction(auc_id) != 0) {
+        fs_store_remove_auction(auc_id);
+        unlock_db_mutex(DB_LOCK_CATALOG, "create_auction");
+        remove(staging_path);
+        return DB_FAILED;
     }
 
-    // convert to long
-    long start_time_l = atol(start_time);
-
-    // failed converting (not a numeric type)
-    if (start_time_l == 0) {
-        LOG_DEBUG("[DB] Got a badly formatted START_%3s file", aid );
-        unlock_db_mutex(aid);
-        return -1;
+    // move the asset into the auction
+    if (fs_store_move_asset(auc_id, staging_path, fname) != 0) {
+        fs_store_remove_auction(auc_id);
+        unlock_db_mutex(DB_LOCK_CATALOG, "create_auction");
+        remove(staging_path);
+        return DB_FAILED;
     }
 
-    // current time
-    time_t curr_time = time(NULL);
-    // seconds the auction remained open
-    long end_sec_time = (long)curr_time - start_time_l;
+    /**
+    * Persist the auction information, the auction starts now
+    */
+    struct wal_record rec;
+    init_record(&rec, WAL_OPEN, auc_id, uid);
+    strncpy(rec.name, name, ASSET_NAME_LEN);
+    strncpy(rec.fname, fname, FNAME_LEN);
+    rec.value = sv;
+    rec.time_active = ta;
+
+    // an auction that is committed must expire, so its place in the expiry heap
+    // is taken first. Only new auctions are pushed, so it stays free
+    lock_db_mutex(DB_LOCK_EXPIRY, "expiry");
+    int reserved = expiry_heap_reserve();
+    unlock_db_mutex(DB_LOCK_EXPIRY, "expiry");
+    if (reserved != 0) {
+        LOG_ERROR("[DB] Failed scheduling the expiry of auction %03d", auc_id);
+        fs_store_remove_auction(auc_id);
+        unlock_db_mutex(DB_LOCK_CATALOG, "create_auction");
+        return DB_FAILED;
+    }
+
+    // the auction is also registered in the host's HOSTED directory, then it
+    // is added to the auction table. The host might have logged out meanwhile
+    lock_db_mutex(DB_LOCK_USER, uid);
+
+    if ((status = check_user(uid, passwd)) != DB_OK || commit_record(&rec) != 0) {
+        unlock_db_mutex(DB_LOCK_USER, uid);
+        fs_store_remove_auction(auc_id);
+        unlock_db_mutex(DB_LOCK_CATALOG, "create_auction");
+        return status != DB_OK ? status : DB_FAILED;
+    }
+
+    unlock_db_mutex(DB_LOCK_USER, uid);
+
+    // the closer thread sleeps until the earliest deadline, which may now be this
+    // one. The push takes the place reserved above, so it doesn't fail
+    lock_db_mutex(DB_LOCK_EXPIRY, "expiry");
+    expiry_heap_push(rec.time + ta, auc_id);
+    if (expiry_heap[0].aid == auc_id)
+        arm_expiry_timer();
+    unlock_db_mutex(DB_LOCK_EXPIRY, "expiry");
+
+    unlock_db_mutex(DB_LOCK_CATALOG, "create_auction");
+
+    if (sync_record(&rec) != 0)
+        return DB_FAILED;
+
+    *aid = auc_id;
+    return DB_OK;
+}
 
-    struct tm *tm_time;
-    if ((tm_time = gmtime(&curr_time)) == NULL) {
-        LOG_DEBUG("[DB] Couldn't get current time information")
-        unlock_db_mutex(aid);
-        return -1;
-    }
+/**
+* Closes an auction on behalf of its host. The host and the auction are checked
+* and the auction is closed holding the auction and host locks
+*/
+db_status_t db_close_auction(char *aid, char *uid, char *passwd) {
+    lock_db_mutex(DB_LOCK_AUCTION, aid);
+    lock_db_mutex(DB_LOCK_USER, uid);
 
-    char end_datetime[128];
-    sprintf(end_datetime, "%4d-%02d-%02d %02d:%02d:%02d", 
-                        tm_time->tm_year + 1900, tm_time->tm_mon + 1, tm_time->tm_mday,
-                        tm_time->tm_hour, tm_time->tm_min, tm_time->tm_sec);
+    // CLS doesn't tell unregistered users apart from logged out ones
+    db_status_t status = check_user(uid, passwd);
+    if (status == DB_NO_USER)
+        status = DB_NOT_LOGGED_IN;
 
+    struct auction *auc = get_auction(aid);
+    if (status == DB_OK && auc != NULL && auc->loaded && strcmp(auc->uid, uid) != 0)
+        status = DB_NOT_OWNER;
 
-    /**
-    * Mark auction as ended (create END file)
-    */
-    int fd;
-    char end_file_path[128];
-    sprintf(end_file_path, "AUCTIONS/%3s/END_%3s.txt", aid, aid);
-    if ((fd = open(end_file_path, O_CREAT | O_WRONLY, SERVER_MODE)) < 0) {
-        LOG_DEBUG("[DB] Failed creating auction %s END file ", aid);
-        unlock_db_mutex(aid);
-        return -1;
-    }
+    if (status == DB_OK)
+        status = check_auction(auc, aid);
 
-    // we do this because we usually use file streams to write to files :l
-    if (close(fd) != 0) {
-        LOG_DEBUG("[DB] Failed closing auction %s creation file descriptor, resources may be leaking", aid);
-        LOG_DEBUG("[DB] open: %s", strerror(errno));
+    if (status != DB_OK) {
+        unlock_db_mutex(DB_LOCK_USER, uid);
+        unlock_db_mutex(DB_LOCK_AUCTION, aid);
+        return status;
     }
 
     /**
-    * Write auction end information
+    * Mark auction as ended, it remained active until now
     */
-    char end_data[258];
-    sprintf(end_data, "%s %ld", end_datetime, end_sec_time);
-    if ((fp = fopen(end_file_path, "w")) == NULL) {
-        LOG_DEBUG("[DB] Failed writting information to auction %s END file", aid);
-        unlock_db_mutex(aid);
-        return -1;
+    struct wal_record rec;
+    init_record(&rec, WAL_CLOSE, atoi(aid), NULL);
+    if (commit_record(&rec) != 0) {
+        LOG_DEBUG("[DB] Failed closing auction %s", aid);
+        status = DB_FAILED;
     }
 
-    if (fputs(end_data, fp) < 0) {
-        LOG_DEBUG("[DB] Failed writting information to auction %s END file", aid);
-        fclose(fp);
-        unlock_db_mutex(aid);
-        return -1;
-    }
+    unlock_db_mutex(DB_LOCK_USER, uid);
+    unlock_db_mutex(DB_LOCK_AUCTION, aid);
 
-    fclose(fp);
+    if (status == DB_OK && sync_record(&rec) != 0)
+        status = DB_FAILED;
 
-    unlock_db_mutex(aid);
-    return 0;
+    return status;
 }
 
-int get_last_bid(char *aid) {
-    lock_db_mutex("get last bid");
-
-    char bid_path[128];
-    sprintf(bid_path, "AUCTIONS/%3s/BIDS", aid);
-
-    struct dirent **entries;
-
-    int n_entries = scandir(bid_path, &entries, NULL, alphasort);
-    if (n_entries < 0) {
-        LOG_DEBUG("[DB] Failed retrieving user auctions");
-        LOG_DEBUG("[DB] scandir: %s", strerror(errno));
-        unlock_db_mutex("list");
-        return -1;
-    }
-    
-    int last_bid;
-    if (sscanf(entries[n_entries - 1]->d_name, "%d.txt", &last_bid) != 1)
-        last_bid = 0; //no bids yet 
-
-    //free entries
-    for (int i=0; i<n_entries; i++)
-        free(entries[i]);
-    free(entries);
-
-    unlock_db_mutex("get last bid");
-    return last_bid;
-}
+/**
+* Places a bid on an auction. The bidder, the auction and the bid value are
+* checked and the bid is committed holding the auction and bidder locks, so the
+* highest bid can't change in between
+*/
+db_status_t db_place_bid(char *aid, char *uid, char *passwd, int value) {
+    lock_db_mutex(DB_LOCK_AUCTION, aid);
+    lock_db_mutex(DB_LOCK_USER, uid);
 
-int bid(char *aid, char *uid, int value) {
-    lock_db_mutex("bid");
+    db_status_t status = check_user(uid, passwd);
 
-    // get starting time
-    FILE *fp;
-    char auction_path[128];
-    sprintf(auction_path, "AUCTIONS/%3s/START_%3s.txt", aid, aid);
-    if ((fp = fopen(auction_path, "r")) == NULL) {
-        LOG_DEBUG("[DB] Failed reading from auction %s information file, databsae might be corrupted", aid);
-        unlock_db_mutex(aid);
-        return 1;
-    }
+    struct auction *auc = get_auction(aid);
+    if (status == DB_OK && auc != NULL && auc->loaded && strcmp(auc->uid, uid) == 0)
+        status = DB_OWN_AUCTION;
 
-    char auction_info[256];
-    if (fgets(auction_info, 128, fp) == NULL) {
-        LOG_DEBUG("[DB] Failed reading from auction %s information file, database might be corrupted", aid);
-        fclose(fp);
-        unlock_db_mutex(aid);
-        return 1;
-    };
+    if (status == DB_OK)
+        status = check_auction(auc, aid);
 
-    fclose(fp);
+    if (status == DB_OK && value <= (auc->top_bid > 0 ? auc->top_bid : auc->start_value))
+        status = DB_BID_REFUSED;
 
-    // read last entry in START file (the start unix timestamp of the auction)
-    char *start_time = strtok(auction_info, " ");
-    for (int i = 0; i < 6; ++i) {
-        start_time = strtok(NULL, " ");
+    if (status != DB_OK) {
+        unlock_db_mutex(DB_LOCK_USER, uid);
+        unlock_db_mutex(DB_LOCK_AUCTION, aid);
+        return status;
     }
 
-    start_time = strtok(NULL, "\n");
-    if (start_time == NULL) {
-        LOG_DEBUG("[DB] Got a badly formatted START_%3s file", aid );
-        unlock_db_mutex(aid);
-        return -1;
+    // the auction is also registered in the bidder's BIDDED directory
+    struct wal_record rec;
+    init_record(&rec, WAL_BID, atoi(aid), uid);
+    rec.value = value;
+    if (commit_record(&rec) != 0) {
+        LOG_DEBUG("[DB] Failed placing bid %d on auction %s", value, aid);
+        status = DB_FAILED;
     }
 
-    // convert to long
-    long start_time_l = atol(start_time);
-
-    // failed converting (not a numeric type)
-    if (start_time_l == 0) {
-        LOG_DEBUG("[DB] Got a badly formatted START_%3s file", aid );
-        unlock_db_mutex(aid);
-        return -1;
-    }
+    unlock_db_mutex(DB_LOCK_USER, uid);
+    unlock_db_mutex(DB_LOCK_AUCTION, aid);
 
-    // current time
-    time_t curr_time = time(NULL);
-    // seconds elapsed since the beginning of the auction
-    long bid_sec_time = (long)curr_time - start_time_l;
+    if (status == DB_OK && sync_record(&rec) != 0)
+        status = DB_FAILED;
 
-    struct tm *tm_time;
-    if ((tm_time = gmtime(&curr_time)) == NULL) {
-        LOG_DEBUG("[DB] Couldn't get current time information")
-        unlock_db_mutex(aid);
-        return -1;
-    }
+    return status;
+}
 
-    char bid_datetime[128];
-    sprintf(bid_datetime, "%4d-%02d-%02d %02d:%02d:%02d", 
-                        tm_time->tm_year + 1900, tm_time->tm_mon + 1, tm_time->tm_mday,
-                        tm_time->tm_hour, tm_time->tm_min, tm_time->tm_sec);
+/**
+* Writes the auctions a user has bid on, ended by '\n', into the size bytes of
+* buff. Returns the number of bytes written, the result isn't NUL terminated
+*/
+int get_user_bids(char *uid, char *buff, int size) {
+    int written = 0;
 
+    lock_db_mutex(DB_LOCK_USER, uid);
 
-    int fd;
-    char bid_path[128];
-    sprintf(bid_path, "AUCTIONS/%3s/BIDS/%06d.txt", aid, value);
-    if ((fd = open(bid_path, O_CREAT | O_WRONLY, SERVER_MODE)) < 0) {
-        LOG_DEBUG("[DB] Failed creating bid file %s %d", aid, value);
-        LOG_DEBUG("close: %s", strerror(errno));
-        unlock_db_mutex("bid");
-        return -1;
-    }
+    struct user *user = get_user(uid);
+    if (user != NULL)
+        written = write_aid_set(&user->bidded, buff, size);
 
-    if (close(fd) != 0) {
-        LOG_DEBUG("[DB] Failed closing bid file %s, resources may be leaking", aid);
-        LOG_DEBUG("close: %s", strerror(errno));
-    }
+    unlock_db_mutex(DB_LOCK_USER, uid);
 
-    char bid_info[256];
-    sprintf(bid_info, "%.6s %s %ld\n", uid, bid_datetime, bid_sec_time);
+    buff[written++] = '\n';
+    return written;
+}
 
-    if ((fp = fopen(bid_path, "w")) == NULL) {
-        LOG_DEBUG("[DB] Failed writting information to auction bid %s END file", aid);
-        unlock_db_mutex("bid");
-        return -1;
+/**
+* Get the mutex that guards `resource` of the given lock class
+*/
+pthread_mutex_t *get_db_mutex(db_lock_t type, char *resource) {
+    switch (type) {
+        case DB_LOCK_CATALOG: return &catalog_mutex;
+        case DB_LOCK_EXPIRY:  return &expiry_mutex;
+        case DB_LOCK_AUCTION: return &auction_mutexes[atoi(resource) % DB_LOCK_STRIPES];
+        case DB_LOCK_USER:    return &user_mutexes[atoi(resource) % DB_LOCK_STRIPES];
+        default:              return NULL;
     }
+}
 
-    if (fputs(bid_info, fp) < 0) {
-        LOG_DEBUG("[DB] Failed writting information to auction bid %s END file", aid);
-        fclose(fp);
-        unlock_db_mutex("bid");
-        return -1;
-    }
+int lock_db_mutex(db_lock_t type, char *resource) {
+    pthread_mutex_t *mutex = get_db_mutex(type, resource);
+    struct lock_stats *stats = &lock_stats[type];
 
-    fclose(fp);
+    // only measure the wait when the lock is already taken
+    if (pthread_mutex_trylock(mutex) != 0) {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
 
-    int ufd;
-    char user_bidded[32];
-    sprintf(user_bidded, "USERS/%.6s/BIDDED/%.3s.txt", uid, aid);
-    if ((ufd = open(user_bidded, O_CREAT, SERVER_MODE)) < 0) {
-        LOG_DEBUG("[DB] Failed creating bid file for user %s on auction %s", uid, aid);
-        unlock_db_mutex("bid");
-        return -1;
-    }
+        if (pthread_mutex_lock(mutex) != 0) {
+            LOG_DEBUG("[DB] Failed locking mutex for resource %s", resource);
+            LOG_ERROR("Failed pthread_mutex_lock, fatal...");
+            exit(1);
+        }
 
-    if (close(fd) != 0) {
-        LOG_DEBUG("[DB] Failed closing bid file %s, resources may be leaking", aid);
-        LOG_DEBUG("close: %s", strerror(errno));
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        long waited = (end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec);
+        __atomic_add_fetch(&stats->contended, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&stats->wait_ns, waited, __ATOMIC_RELAXED);
     }
 
-    unlock_db_mutex("bid");
+    __atomic_add_fetch(&stats->acquired, 1, __ATOMIC_RELAXED);
     return 0;
 }
 
-int get_user_bids(char *uid, char *response) {
-    lock_db_mutex("get user bids");
-    struct dirent **entries;
-
-    char bids_dir[32];
-    sprintf(bids_dir, "USERS/%.6s/BIDDED", uid);
-    int n_entries = scandir(bids_dir, &entries, NULL, alphasort);
-    if (n_entries < 0) {
-        LOG_DEBUG("[DB] Failed retrieving user auctions");
-        LOG_DEBUG("[DB] scandir: %s", strerror(errno));
-        unlock_db_mutex("get user bids");
-        return -1;
+int unlock_db_mutex(db_lock_t type, char *resource) {
+    if (pthread_mutex_unlock(get_db_mutex(type, resource)) != 0) {
+        LOG_DEBUG("[DB] Failed unlocking mutex for resource %s", resource);
+        LOG_ERROR("Failed pthread_mutex_unlock, fatal...");
+        exit(1);
     }
-    
-    int written = 0;
-    char curr_auc_path[32];
-    int check_fd;
-    for (int i = 0; i < n_entries; i++) {
-        if (entries[i]->d_name[0] == '.') continue;
-
-        sprintf(curr_auc_path, "AUCTIONS/%.3s/END_%.3s.txt", entries[i]->d_name, entries[i]->d_name);
-        char auc_status[8];
-        if ((check_fd = open(curr_auc_path, 0, SERVER_MODE)) < 0) {
-            sprintf(auc_status, " %.3s 1", entries[i]->d_name); // not ended
-        } else {
-            sprintf(auc_status, " %.3s 0", entries[i]->d_name); // ended
-            if (close(check_fd) != 0) {
-                LOG_DEBUG("[DB] Failed closing file descriptor, resources might be leaking")
-                LOG_DEBUG("[DB] closedir: %s", strerror(errno));
-            };
-        }
+    return 0;
+}
 
-        strcat(response, auc_status);
-        written += strlen(auc_status);
+/**
+* Logs the database statistics
+*/
+void log_db_stats() {
+    for (int i = 0; i < DB_LOCK_CLASSES; ++i) {
+        struct lock_stats *stats = &lock_stats[i];
+        unsigned long acquired = __atomic_load_n(&stats->acquired, __ATOMIC_RELAXED);
+        unsigned long contended = __atomic_load_n(&stats->contended, __ATOMIC_RELAXED);
+        unsigned long wait_ns = __atomic_load_n(&stats->wait_ns, __ATOMIC_RELAXED);
 
-        free(entries[i]);
+        LOG("[DB] %-8s locks: %lu acquired, %lu contended, %lu us waited",
+                lock_class_names[i], acquired, contended, wait_ns / 1000);
     }
 
-    free(entries);
-
-    strcat(response, "\n");
-    written += 1;
+    // SRC cache of every auction that was shown
+    int count = get_auction_count();
+    for (int aid = 1; aid <= count; ++aid) {
+        struct record_cache *cache = &auction_entry(aid)->src;
+        unsigned long hits = __atomic_load_n(&cache->hits, __ATOMIC_RELAXED);
+        unsigned long misses = __atomic_load_n(&cache->misses, __ATOMIC_RELAXED);
+        if (hits + misses > 0)
+            LOG("[DB] auction %03d SRC cache: %lu hits, %lu misses, %.1f%% hit ratio",
+                    aid, hits, misses, 100.0 * hits / (hits + misses));
+    }
 
-    unlock_db_mutex("get user bids");
-    return written;
-}
+    LOG("[DB] SRC cache: %ld of %d bytes", __atomic_load_n(&src_cache_bytes, __ATOMIC_RELAXED), SRC_CACHE_MAX_BYTES);
 
-int lock_db_mutex(char *resource) {
-    if (pthread_mutex_lock(&db_mutex) != 0) {
-        LOG_DEBUG("[DB] Failed locking mutex for resource %s", resource);
-        LOG_ERROR("Failed pthread_mutex_lock, fatal...");
-        exit(1);
-    }    
-    return 0;
+    if (engine == &engines[DB_ENGINE_FS])
+        write_behind_stats();
 }
-
-int unlock_db_mutex(char *resource) {
-    if (pthread_mutex_unlock(&db_mutex) != 0) {
-        LOG_DEBUG("[DB] Failed unlocking mutex for resource %s", resource);
-        LOG_ERROR("Failed pthread_mutex_lock, fatal...");
-        exit(1);
-    }    
-    return 0;
-}
\ No newline at end of file
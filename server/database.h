@@ -1,8 +1,33 @@
 #ifndef __DATABASE_H__
 #define __DATABASE_H__
 
+typedef enum {
+    DB_ENGINE_FS,   // directory layout, one file per user, auction and bid
+    DB_ENGINE_LOG,  // write-ahead log
+    DB_ENGINE_MEM,  // memory only, nothing is persisted
+} db_engine_t;
+
+/**
+* When a committed change is acknowledged, see wal.h
+*/
+typedef enum {
+    DB_DURABILITY_NONE,     // once it is written, a crash of the machine may lose it
+    DB_DURABILITY_GROUP,    // once it is synced together with concurrent changes
+    DB_DURABILITY_STRICT,   // once it is synced on its own
+} db_durability_t;
+
+void set_database_engine(db_engine_t engine);
+void set_database_durability(db_durability_t level);
+void set_database_extended_aids();
+int get_aid_size();
 int init_database();
-int update_database();
+int export_database();
+void close_database();
+void wait_checkpoint();
+int checkpoint_database();
+void wait_expiry();
+int close_expired_auctions();
+void log_db_stats();
 
 /**
 * DB status API 
@@ -15,12 +40,14 @@ int exists_auction(char *aid);
 int is_auction_finished(char *aid);
 
 int get_auction_info(char *aid, char *buff, int n);
-int get_user_auctions(char *uid, char *buff);
-int get_auctions_list(char *buff);
-int get_auction_bidders_list(char *aid, char *buff);
+int get_user_auctions(char *uid, char *buff, int size);
+int get_auctions_list(char *buff, int size);
+unsigned long get_db_version();
+int get_auction_bidders_list(char *aid, char *buff, int size);
+int get_cached_auction_record(char *aid, char *buff, int size, unsigned long *version);
+void cache_auction_record(char *aid, unsigned long version, char *response, int len);
 
-int get_last_bid(char *aid);
-int get_user_bids(char *uid, char *response);
+int get_user_bids(char *uid, char *buff, int size);
 /**
 * DB action API 
 */
@@ -30,9 +57,25 @@ int log_out_user(char *uid);
 int register_user(char *uid, char* passwd);
 int unregister_user(char *uid);
 
-int create_new_auction(char *uid, char *name, char *fname, int sv, int ta, int fisze, int fd);
-int close_auction(char *aid);
+/**
+* Status of the DB transactions, which validate the request and commit it in a
+* single critical section
+*/
+typedef enum {
+    DB_OK,
+    DB_NO_USER,         // user isn't registered
+    DB_NOT_LOGGED_IN,   // user isn't logged in or the password doesn't match
+    DB_NO_AUCTION,
+    DB_NOT_OWNER,       // user doesn't host the auction
+    DB_OWN_AUCTION,     // user hosts the auction
+    DB_AUCTION_ENDED,
+    DB_BID_REFUSED,     // bid isn't higher than the highest bid or the start value
+    DB_FAILED,
+} db_status_t;
 
-int bid(char *aid, char *uid, int value);
+db_status_t db_open_auction(char *uid, char *passwd, char *name, char *fname, int sv, int ta,
+                                int fsize, int conn_fd, int *aid);
+db_status_t db_close_auction(char *aid, char *uid, char *passwd);
+db_status_t db_place_bid(char *aid, char *uid, char *passwd, int value);
 
 #endif
\ No newline at end of file
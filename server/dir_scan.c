@@ -0,0 +1,123 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+
+#include "../utils/logging.h"
+
+#include "dir_scan.h"
+
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/**
+* Opens the directory `path`, relative to the directory `at_fd` (or AT_FDCWD),
+* for scanning. Returns 0 on success and -1 on failure
+*/
+int dir_scan_open(struct dir_scan *scan, int at_fd, char *path) {
+    scan->n = 0;
+    scan->pos = 0;
+    if ((scan->fd = openat(at_fd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) {
+        LOG_DEBUG("[DB] openat %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+* Get the name of the next entry in the directory, skipping "." and "..".
+* Returns NULL once every entry was read
+*/
+char *dir_scan_next(struct dir_scan *scan) {
+    while (1) {
+        if (scan->pos >= scan->n) {
+            scan->n = syscall(SYS_getdents64, scan->fd, scan->buff, DIR_SCAN_BUFF_SZ);
+            scan->pos = 0;
+            if (scan->n <= 0) {
+                if (scan->n < 0)
+                    LOG_DEBUG("[DB] getdents64: %s", strerror(errno));
+                return NULL;
+            }
+        }
+
+        struct linux_dirent64 *entry = (struct linux_dirent64 *)(scan->buff + scan->pos);
+        scan->pos += entry->d_reclen;
+
+        char *name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            continue;
+
+        return name;
+    }
+}
+
+/**
+* Closes the scanned directory
+*/
+void dir_scan_close(struct dir_scan *scan) {
+    if (scan->fd >= 0 && close(scan->fd) != 0) {
+        LOG_DEBUG("[DB] Failed closing directory, resources may be leaking");
+        LOG_DEBUG("[DB] close: %s", strerror(errno));
+    }
+
+    scan->fd = -1;
+}
+
+/**
+* Reads up to size - 1 bytes of the file `path`, relative to the directory
+* `at_fd`, into buff and terminates them. Returns the number of bytes read and -1
+* on failure
+*/
+int read_small_file(int at_fd, char *path, char *buff, int size) {
+    int fd;
+    if ((fd = openat(at_fd, path, O_RDONLY | O_CLOEXEC)) < 0)
+        return -1;
+
+    ssize_t n = read(fd, buff, size - 1);
+    close(fd);
+    if (n < 0)
+        return -1;
+
+    buff[n] = '\0';
+    return n;
+}
+
+/**
+* Removes the directory `path`, relative to the directory `at_fd`, and everything
+* in it. Returns 0 on success and -1 on failure
+*/
+int remove_dir_tree(int at_fd, char *path) {
+    struct dir_scan scan;
+    if (dir_scan_open(&scan, at_fd, path) != 0)
+        return -1;
+
+    int ret = 0;
+    char *name;
+    while ((name = dir_scan_next(&scan)) != NULL) {
+        if (unlinkat(scan.fd, name, 0) == 0)
+            continue;
+
+        if ((errno != EISDIR && errno != EPERM) || remove_dir_tree(scan.fd, name) != 0) {
+            LOG_DEBUG("[DB] Failed removing %s", name);
+            ret = -1;
+        }
+    }
+
+    dir_scan_close(&scan);
+    if (unlinkat(at_fd, path, AT_REMOVEDIR) != 0) {
+        LOG_DEBUG("[DB] unlinkat %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    return ret;
+}
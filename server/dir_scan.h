@@ -0,0 +1,25 @@
+#ifndef __DIR_SCAN_H__
+#define __DIR_SCAN_H__
+
+#define DIR_SCAN_BUFF_SZ 32768
+
+/**
+* Reads the entries of a directory with getdents64, a buffer of entries at a
+* time. Directories are opened relative to the directory they are in, so a
+* subtree is scanned without resolving its path again for every file.
+*/
+struct dir_scan {
+    int fd;
+    long n;                             // bytes of entries in buff
+    long pos;                           // next entry in buff
+    char buff[DIR_SCAN_BUFF_SZ];
+};
+
+int dir_scan_open(struct dir_scan *scan, int at_fd, char *path);
+char *dir_scan_next(struct dir_scan *scan);
+void dir_scan_close(struct dir_scan *scan);
+
+int read_small_file(int at_fd, char *path, char *buff, int size);
+int remove_dir_tree(int at_fd, char *path);
+
+#endif
@@ -0,0 +1,859 @@
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "../utils/constants.h"
+#include "../utils/config.h"
+#include "../utils/logging.h"
+
+#include "fs_store.h"
+
+static const mode_t SERVER_MODE = S_IREAD | S_IWRITE | S_IEXEC;
+static const mode_t FILE_MODE = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH;
+
+/**
+* Directories written by the FS engine are kept open and their files are reached
+* relative to them with the *at() calls, so a write resolves a single path
+* component instead of walking the path from the database root. USERS and
+* AUCTIONS stay open, user and auction directories are cached in a direct-mapped
+* table: a directory takes the slot of its key and evicts the directory that was
+* there. A slot in use by another thread isn't evicted, the directory is then
+* opened for that call only
+*/
+struct dir_handle {
+    int key;                            // UID * 2 for users, AID * 2 + 1 for auctions
+    int fd;                             // -1 if the slot is empty
+    int refs;                           // callers using fd
+};
+
+static int users_fd = -1;
+static int auctions_fd = -1;
+static struct dir_handle dir_cache[FS_DIR_CACHE_SZ];
+static pthread_mutex_t dir_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+* The auction table file is mapped whole, its first record holds a header that
+* identifies the layout of the records
+*/
+struct auction_table_header {
+    char magic[8];
+    int32_t record_size;
+};
+
+static const char TABLE_MAGIC[8] = "ASTBL1";
+static struct auction_record *auction_table = NULL;
+static long table_records = 0;          // records mapped, including the header
+
+struct auction_record *table_record(int aid);
+int open_root_dir(char *path);
+int get_user_dir(char *uid, struct dir_handle **handle);
+int get_auction_dir(int aid, struct dir_handle **handle);
+void put_dir(int fd, struct dir_handle *handle);
+void auction_subdir(int aid, char *buff);
+void remove_files(int at_fd, char *path);
+int touch_file(int at_fd, char *path);
+int write_file(int at_fd, char *path, char *content);
+
+/**
+* Creates the USERS, AUCTIONS and staging directories in the current directory
+* and opens USERS and AUCTIONS. Assets left in the staging directory by uploads
+* that never finished are removed. Returns 0 on success and -1 on failure
+*/
+int fs_store_init() {
+    // create USERS dir
+    if (mkdir("USERS", SERVER_MODE) != 0) {
+        if (errno != EEXIST) {
+            LOG_ERROR("[DB] Failed creating USERS directory in database");
+            LOG_ERROR("[DB] mkdir: %s", strerror(errno));
+            return -1;
+        }
+    }
+
+    // create AUCTIONS dir
+    if (mkdir("AUCTIONS", SERVER_MODE) != 0) {
+        if (errno != EEXIST) {
+            LOG_ERROR("[DB] Failed creating AUCTIONS directory");
+            LOG_ERROR("[DB] mkdir: %s", strerror(errno));
+            return -1;
+        }
+    }
+
+    // create staging dir
+    if (mkdir(DB_STAGING_DIR, SERVER_MODE) != 0) {
+        if (errno != EEXIST) {
+            LOG_ERROR("[DB] Failed creating %s directory", DB_STAGING_DIR);
+            LOG_ERROR("[DB] mkdir: %s", strerror(errno));
+            return -1;
+        }
+    }
+
+    DIR *dp;
+    struct dirent *cur;
+    if ((dp = opendir(DB_STAGING_DIR)) == NULL) {
+        LOG_ERROR("[DB] opendir: %s", strerror(errno));
+        return -1;
+    }
+
+    while ((cur = readdir(dp)) != NULL) {
+        if (cur->d_name[0] == '.') continue;
+
+        if (unlinkat(dirfd(dp), cur->d_name, 0) != 0) {
+            LOG_DEBUG("[DB] Couldn't remove staged asset %s", cur->d_name);
+            LOG_DEBUG("[DB] unlinkat: %s", strerror(errno));
+        }
+    }
+
+    if (closedir(dp) != 0) {
+        LOG_DEBUG("[DB] Failed closing file descriptor, resources may be leaking");
+        LOG_DEBUG("[DB] closedir: %s", strerror(errno));
+    }
+
+    if ((users_fd = open_root_dir("USERS")) < 0 || (auctions_fd = open_root_dir("AUCTIONS")) < 0)
+        return -1;
+
+    for (int i = 0; i < FS_DIR_CACHE_SZ; ++i)
+        dir_cache[i].fd = -1;
+
+    return 0;
+}
+
+/**
+* Maps the auction table, with room for AIDs up to `max_aid`, creating it if it
+* doesn't exist. A table with another layout is emptied, its auctions are then
+* read from their START and END files. Until the table is open, auctions aren't
+* recorded in it. Returns 0 on success and -1 on failure
+*/
+int fs_store_open_table(int max_aid) {
+    int fd;
+    if ((fd = open(DB_AUCTION_TABLE_FILE, O_RDWR | O_CREAT | O_CLOEXEC, FILE_MODE)) < 0) {
+        LOG_ERROR("[DB] Failed opening %s", DB_AUCTION_TABLE_FILE);
+        LOG_ERROR("[DB] open: %s", strerror(errno));
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        LOG_ERROR("[DB] fstat: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    struct auction_table_header header;
+    int valid = pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+                memcmp(header.magic, TABLE_MAGIC, sizeof(TABLE_MAGIC)) == 0 &&
+                header.record_size == sizeof(struct auction_record);
+    if (!valid && st.st_size > 0) {
+        LOG_VERBOSE("[DB] %s has another layout, rebuilding it", DB_AUCTION_TABLE_FILE);
+        st.st_size = 0;
+    }
+
+    // the table only grows, it may hold AIDs of a server run with extended AIDs
+    long records = max_aid + 1;
+    if (st.st_size / (long)sizeof(struct auction_record) > records)
+        records = st.st_size / sizeof(struct auction_record);
+
+    size_t size = records * sizeof(struct auction_record);
+    if ((!valid && ftruncate(fd, 0) != 0) || ftruncate(fd, size) != 0) {
+        LOG_ERROR("[DB] ftruncate: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    void *table = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (table == MAP_FAILED) {
+        LOG_ERROR("[DB] Failed mapping %s", DB_AUCTION_TABLE_FILE);
+        LOG_ERROR("[DB] mmap: %s", strerror(errno));
+        return -1;
+    }
+
+    auction_table = table;
+    table_records = records;
+    if (!valid) {
+        memcpy(header.magic, TABLE_MAGIC, sizeof(TABLE_MAGIC));
+        header.record_size = sizeof(struct auction_record);
+        memcpy(auction_table, &header, sizeof(header));
+    }
+
+    return 0;
+}
+
+/**
+* Writes the changes to the auction table to disk
+*/
+void fs_store_sync() {
+    if (auction_table != NULL &&
+        msync(auction_table, table_records * sizeof(struct auction_record), MS_SYNC) != 0) {
+        LOG_ERROR("[DB] Failed writing %s", DB_AUCTION_TABLE_FILE);
+        LOG_ERROR("[DB] msync: %s", strerror(errno));
+    }
+}
+
+/**
+* Creates a user's directories, login and password files. Returns 0 on success
+* and -1 on failure
+*/
+int fs_store_register(char *uid, char *passwd) {
+    // create user directory (e.g root/USERS/123456)
+    char user_dir[8];
+    sprintf(user_dir, "%.6s", uid);
+    if (mkdirat(users_fd, user_dir, SERVER_MODE) != 0) {
+        if (errno != EEXIST) {
+            LOG_DEBUG("[DB] Couldn't create user directory for user %s", uid);
+            LOG_DEBUG("[DB] mkdirat: %s", strerror(errno));
+            return -1;
+        }
+    }
+
+    struct dir_handle *handle;
+    int user_fd;
+    if ((user_fd = get_user_dir(uid, &handle)) < 0)
+        return -1;
+
+    // create user's HOSTED dir
+    if (mkdirat(user_fd, "HOSTED", SERVER_MODE) != 0) {
+        if (errno != EEXIST) {
+            LOG_DEBUG("[DB] Couldn't create HOSTED directory for user %s", uid);
+            LOG_DEBUG("[DB] mkdirat: %s", strerror(errno));
+            put_dir(user_fd, handle);
+            return -1;
+        }
+    }
+
+    // create user's BIDDED dir
+    if (mkdirat(user_fd, "BIDDED", SERVER_MODE) != 0) {
+        if (errno != EEXIST) {
+            LOG_DEBUG("[DB] Couldn't create BIDDED directory for user %s", uid);
+            LOG_DEBUG("[DB] mkdirat: %s", strerror(errno));
+            put_dir(user_fd, handle);
+            return -1;
+        }
+    }
+
+    // mark user as logged in (e.g touch root/USERS/123456/123456_login.txt)
+    char user_file_path[32];
+    sprintf(user_file_path, "%.6s_login.txt", uid);
+    if (touch_file(user_fd, user_file_path) != 0) {
+        LOG_DEBUG("[DB] Couldn't create login file for user %6s", uid);
+        put_dir(user_fd, handle);
+        return -1;
+    }
+
+    // create user password file (e.g root/USERS/123456/123456_pass.txt)
+    sprintf(user_file_path, "%.6s_pass.txt", uid);
+    int pass_fd;
+    if ((pass_fd = openat(user_fd, user_file_path, O_CREAT | O_WRONLY | O_CLOEXEC, SERVER_MODE)) < 0) {
+        LOG_ERROR("[DB] openat: %s", strerror(errno));
+        LOG_DEBUG("[DB] Couldn't create user password file for user %s", uid);
+        put_dir(user_fd, handle);
+        return -1;
+    }
+
+    // write password
+    if (write(pass_fd, passwd, 8) != 8) {
+        LOG_DEBUG("[DB] Couldn't write password for user %s", uid);
+        LOG_ERROR("[DB] write: %s", strerror(errno));
+        if (unlinkat(user_fd, user_file_path, 0) != 0) {
+            LOG_DEBUG("[DB] Failed removing %s_pass.txt after failure registering user, a ghost user %s now exists", uid, uid);
+        }
+
+        if (close(pass_fd) != 0) {
+            LOG_DEBUG("[DB] Failed closing file descriptor, resources might be leaking");
+            LOG_DEBUG("[DB] close: %s", strerror(errno));
+        }
+
+        put_dir(user_fd, handle);
+        return -1;
+    }
+
+    if (close(pass_fd) != 0) {
+        LOG_DEBUG("[DB] Failed closing file descriptor, resources might be leaking");
+        LOG_DEBUG("[DB] close: %s", strerror(errno));
+    };
+
+    put_dir(user_fd, handle);
+    return 0;
+}
+
+/**
+* Removes a user's login and password files. Returns 0 on success and -1 on failure
+*/
+int fs_store_unregister(char *uid) {
+    struct dir_handle *handle;
+    int user_fd;
+    if ((user_fd = get_user_dir(uid, &handle)) < 0)
+        return -1;
+
+    // remove user's login
+    char user_file_path[32];
+    sprintf(user_file_path, "%.6s_login.txt", uid);
+    if (unlinkat(user_fd, user_file_path, 0) != 0) {
+        LOG_DEBUG("[DB] Failed removing login file for user %s", uid);
+        LOG_DEBUG("[DB] unlinkat: %s", strerror(errno));
+        put_dir(user_fd, handle);
+        return -1;
+    }
+
+    // remove user's passwd
+    sprintf(user_file_path, "%.6s_pass.txt", uid);
+    if (unlinkat(user_fd, user_file_path, 0) != 0) {
+        LOG_DEBUG("[DB] Failed removing password file for user %s", uid);
+        LOG_DEBUG("[DB] unlinkat: %s", strerror(errno));
+        put_dir(user_fd, handle);
+        return -1;
+    }
+
+    put_dir(user_fd, handle);
+    return 0;
+}
+
+int fs_store_login(char *uid) {
+    struct dir_handle *handle;
+    int user_fd;
+    if ((user_fd = get_user_dir(uid, &handle)) < 0)
+        return -1;
+
+    char user_login_path[32];
+    sprintf(user_login_path, "%.6s_login.txt", uid);
+    int err = touch_file(user_fd, user_login_path);
+    put_dir(user_fd, handle);
+    if (err != 0) {
+        LOG_DEBUG("[DB] Couldn't create login file for user %s", uid);
+        return -1;
+    }
+
+    return 0;
+}
+
+int fs_store_logout(char *uid) {
+    struct dir_handle *handle;
+    int user_fd;
+    if ((user_fd = get_user_dir(uid, &handle)) < 0)
+        return -1;
+
+    char user_login_path[32];
+    sprintf(user_login_path, "%.6s_login.txt", uid);
+    int err = unlinkat(user_fd, user_login_path, 0);
+    if (err != 0) {
+        LOG_DEBUG("[DB] Failed removing login file %s", uid);
+        LOG_DEBUG("[DB] unlinkat: %s", strerror(errno));
+    }
+
+    put_dir(user_fd, handle);
+    return err == 0 ? 0 : -1;
+}
+
+/**
+* Writes the directory of the auction with `aid` into buff. AIDs that fit in
+* AID_SIZE digits are kept in AUCTIONS/AID, extended AIDs are sharded by their
+* thousands (e.g. AUCTIONS/X123/123456) so no directory holds more than a
+* thousand auctions
+*/
+void fs_store_auction_dir(int aid, char *buff) {
+    strcpy(buff, "AUCTIONS/");
+    auction_subdir(aid, buff + strlen(buff));
+}
+
+/**
+* Writes the directory of the auction with `aid`, relative to AUCTIONS, into buff
+*/
+void auction_subdir(int aid, char *buff) {
+    if (aid <= MAX_AUCTIONS)
+        sprintf(buff, "%03d", aid);
+    else
+        sprintf(buff, "X%03d/%0*d", aid / 1000, EXT_AID_SIZE, aid);
+}
+
+/**
+* Creates the directory of the auction with `aid`, with its BIDS and ASSET
+* folders. Returns 0 on success and -1 on failure
+*/
+int fs_store_create_auction(int aid) {
+    // create the shard of extended AIDs
+    if (aid > MAX_AUCTIONS) {
+        char shard[16];
+        sprintf(shard, "X%03d", aid / 1000);
+        if (mkdirat(auctions_fd, shard, SERVER_MODE) != 0 && errno != EEXIST) {
+            LOG_DEBUG("[DB] Failed creating auctions shard %s", shard);
+            LOG_DEBUG("[DB] mkdirat: %s", strerror(errno));
+            return -1;
+        }
+    }
+
+    // create auction directory
+    char auc_dir[32];
+    auction_subdir(aid, auc_dir);
+    if (mkdirat(auctions_fd, auc_dir, SERVER_MODE) != 0) {
+        if (errno != EEXIST) {
+            LOG_DEBUG("[DB] Failed creating new auction %s", auc_dir);
+            LOG_DEBUG("[DB] mkdirat: %s", strerror(errno));
+            return -1;
+        }
+    }
+
+    struct dir_handle *handle;
+    int auc_fd;
+    if ((auc_fd = get_auction_dir(aid, &handle)) < 0)
+        return -1;
+
+    // create BIDS folder inside dir
+    if (mkdirat(auc_fd, "BIDS", SERVER_MODE) != 0) {
+        if (errno != EEXIST) {
+            LOG_DEBUG("[DB] Failed creating BIDS folder for auction %s", auc_dir);
+            LOG_DEBUG("[DB] mkdirat: %s", strerror(errno));
+            put_dir(auc_fd, handle);
+            return -1;
+        }
+    }
+
+    // create ASSET folder inside dir
+    if (mkdirat(auc_fd, "ASSET", SERVER_MODE) != 0) {
+        if (errno != EEXIST) {
+            LOG_DEBUG("[DB] Failed creating ASSET folder for auction %s", auc_dir);
+            LOG_DEBUG("[DB] mkdirat: %s", strerror(errno));
+            put_dir(auc_fd, handle);
+            return -1;
+        }
+    }
+
+    put_dir(auc_fd, handle);
+    return 0;
+}
+
+/**
+* Rolls back an auction directory creation that went wrong. This prevents
+* ghost auctions from being accumulated in the database
+*/
+void fs_store_remove_auction(int aid) {
+    // the directory is going away, it can't stay cached
+    pthread_mutex_lock(&dir_cache_mutex);
+    struct dir_handle *entry = &dir_cache[(aid * 2 + 1) % FS_DIR_CACHE_SZ];
+    if (entry->fd >= 0 && entry->key == aid * 2 + 1) {
+        if (entry->refs == 0) {
+            close(entry->fd);
+            entry->fd = -1;
+        } else {
+            entry->key = -1; // closed once it's released and evicted
+        }
+    }
+    pthread_mutex_unlock(&dir_cache_mutex);
+
+    struct auction_record *rec = table_record(aid);
+    if (rec != NULL)
+        memset(rec, 0, sizeof(struct auction_record));
+
+    // directory for auction doesn't exist (creation failed because max limit was exceeded)
+    char auc_dir[32];
+    int auc_fd;
+    auction_subdir(aid, auc_dir);
+    if ((auc_fd = openat(auctions_fd, auc_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) {
+        if (errno == ENOENT) { // directory doesn't exist
+            LOG_DEBUG("[DB] Dir doesn't exist / wasn't created (%s)", auc_dir);
+        } else {
+            LOG_DEBUG("[DB] Failed opening %03d auction directory on rollback action, database might be corrupted", aid);
+            LOG_DEBUG("[DB] openat: %s", strerror(errno));
+        }
+        return;
+    }
+
+    // remove all regular files inside directory, its bids and its asset
+    remove_files(auc_fd, ".");
+    remove_files(auc_fd, "BIDS");
+    if (unlinkat(auc_fd, "BIDS", AT_REMOVEDIR) != 0 && errno != ENOENT) {
+        LOG_DEBUG("[DB] Failed removing BIDS directory on rollback action, a ghost auction now exists");
+        LOG_DEBUG("[DB] unlinkat: %s", strerror(errno));
+    }
+
+    remove_files(auc_fd, "ASSET");
+    if (unlinkat(auc_fd, "ASSET", AT_REMOVEDIR) != 0 && errno != ENOENT) {
+        LOG_DEBUG("[DB] Failed removing ASSET directory on rollback action, a ghost auction now exists");
+        LOG_DEBUG("[DB] unlinkat: %s", strerror(errno));
+    }
+
+    if (close(auc_fd) != 0) {
+        LOG_DEBUG("[DB] Failed closing file descriptor, resources may be leaking");
+        LOG_DEBUG("[DB] close: %s", strerror(errno));
+    }
+
+    // remove directory
+    if (unlinkat(auctions_fd, auc_dir, AT_REMOVEDIR) != 0) {
+        LOG_DEBUG("[DB] Failed removing directory on rollback action, a ghost auction now exists");
+        LOG_DEBUG("[DB] unlinkat: %s", strerror(errno));
+    }
+
+    return;
+}
+
+/**
+* Moves the asset received into `staging_path` into the ASSET folder of the
+* auction with `aid`, as `fname`. Returns 0 on success and -1 on failure
+*/
+int fs_store_move_asset(int aid, char *staging_path, char *fname) {
+    struct dir_handle *handle;
+    int auc_fd;
+    if ((auc_fd = get_auction_dir(aid, &handle)) < 0)
+        return -1;
+
+    char asset_path[48];
+    sprintf(asset_path, "ASSET/%.*s", FNAME_LEN, fname);
+    int err = renameat(AT_FDCWD, staging_path, auc_fd, asset_path);
+    if (err != 0)
+        LOG_DEBUG("[DB] renameat: %s", strerror(errno));
+
+    put_dir(auc_fd, handle);
+    return err == 0 ? 0 : -1;
+}
+
+/**
+* Opens the asset `fname` of the auction with `aid` for reading and writes its
+* size into `size`. Returns the file descriptor and -1 on failure
+*/
+int fs_store_open_asset(int aid, char *fname, long *size) {
+    struct dir_handle *handle;
+    int auc_fd;
+    if ((auc_fd = get_auction_dir(aid, &handle)) < 0)
+        return -1;
+
+    char asset_path[48];
+    sprintf(asset_path, "ASSET/%.*s", FNAME_LEN, fname);
+    int afd = openat(auc_fd, asset_path, O_RDONLY | O_CLOEXEC);
+    put_dir(auc_fd, handle);
+    if (afd < 0) {
+        LOG_DEBUG("[DB] openat: %s", strerror(errno));
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(afd, &st) != 0) {
+        LOG_DEBUG("[DB] fstat: %s", strerror(errno));
+        close(afd);
+        return -1;
+    }
+
+    *size = st.st_size;
+    return afd;
+}
+
+/**
+* Writes the START file of an auction and registers it in its host's HOSTED
+* folder. Returns 0 on success and -1 on failure
+*/
+int fs_store_open(int aid, char *uid, char *name, char *fname, int sv, int ta, char *start_datetime, long start_time) {
+    char start_info[256];
+    sprintf(start_info, "%s %s %s %d %d %s %ld\n",
+                            uid, name, fname, sv, ta, start_datetime, start_time);
+
+    // the table is written first, the START file is only kept for compatibility
+    struct auction_record *rec = table_record(aid);
+    if (rec == NULL) {
+        LOG_DEBUG("[DB] Auction %03d doesn't fit in %s", aid, DB_AUCTION_TABLE_FILE);
+        return -1;
+    }
+
+    memset(rec, 0, sizeof(struct auction_record));
+    snprintf(rec->uid, sizeof(rec->uid), "%s", uid);
+    snprintf(rec->name, sizeof(rec->name), "%s", name);
+    snprintf(rec->fname, sizeof(rec->fname), "%s", fname);
+    rec->start_value = sv;
+    rec->time_active = ta;
+    rec->start_time = start_time;
+    rec->status = AUCTION_RECORD_OPEN;
+
+    struct dir_handle *handle;
+    int dir_fd;
+    if ((dir_fd = get_auction_dir(aid, &handle)) < 0)
+        return -1;
+
+    char tmp_path[32];
+    sprintf(tmp_path, "START_%03d.txt", aid);
+    int err = write_file(dir_fd, tmp_path, start_info);
+    put_dir(dir_fd, handle);
+    if (err != 0) {
+        LOG_DEBUG("[DB] Failed writing START file of auction %03d", aid);
+        return -1;
+    }
+
+    if ((dir_fd = get_user_dir(uid, &handle)) < 0)
+        return -1;
+
+    sprintf(tmp_path, "HOSTED/%03d.txt", aid);
+    err = touch_file(dir_fd, tmp_path);
+    put_dir(dir_fd, handle);
+    if (err != 0) {
+        LOG_DEBUG("[DB] Failed registering auction %03d in user %s HOSTED folder", aid, uid);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+* Writes a bid file in the auction's BIDS folder and registers the auction in the
+* bidder's BIDDED folder. Returns 0 on success and -1 on failure
+*/
+int fs_store_bid(int aid, char *uid, int value, char *bid_datetime, long bid_sec_time) {
+    char bid_info[256];
+    sprintf(bid_info, "%.6s %s %ld\n", uid, bid_datetime, bid_sec_time);
+
+    // bids are placed by increasing value, the last one is the top bid. Auctions
+    // opened before the table existed are only kept in their files
+    struct auction_record *rec = table_record(aid);
+    if (rec != NULL && rec->status != AUCTION_RECORD_EMPTY) {
+        rec->top_bid = value;
+        snprintf(rec->top_bidder, sizeof(rec->top_bidder), "%.6s", uid);
+    }
+
+    struct dir_handle *handle;
+    int dir_fd;
+    if ((dir_fd = get_auction_dir(aid, &handle)) < 0)
+        return -1;
+
+    char bid_path[32];
+    sprintf(bid_path, "BIDS/%06d.txt", value);
+    int err = write_file(dir_fd, bid_path, bid_info);
+    put_dir(dir_fd, handle);
+    if (err != 0) {
+        LOG_DEBUG("[DB] Failed creating bid file %03d %d", aid, value);
+        return -1;
+    }
+
+    if ((dir_fd = get_user_dir(uid, &handle)) < 0)
+        return -1;
+
+    char user_bidded[32];
+    sprintf(user_bidded, "BIDDED/%03d.txt", aid);
+    err = touch_file(dir_fd, user_bidded);
+    put_dir(dir_fd, handle);
+    if (err != 0) {
+        LOG_DEBUG("[DB] Failed creating bid file for user %s on auction %03d", uid, aid);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+* Marks an auction as ended by creating its END file with the date time of the
+* auction end and the time in seconds it remained active
+*/
+int fs_store_end(int aid, char *end_datetime, long end_sec_time) {
+    struct auction_record *rec = table_record(aid);
+    if (rec != NULL && rec->status != AUCTION_RECORD_EMPTY) {
+        rec->end_time = rec->start_time + end_sec_time;
+        rec->status = AUCTION_RECORD_ENDED;
+    }
+
+    struct dir_handle *handle;
+    int auc_fd;
+    if ((auc_fd = get_auction_dir(aid, &handle)) < 0)
+        return -1;
+
+    char end_path[32];
+    char end_info[64];
+    sprintf(end_path, "END_%03d.txt", aid);
+    sprintf(end_info, "%s %ld\n", end_datetime, end_sec_time);
+    int err = write_file(auc_fd, end_path, end_info);
+    put_dir(auc_fd, handle);
+    if (err != 0) {
+        LOG_DEBUG("[DB] Failed creating END_%03d.txt file", aid);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+* Copies the record of the auction with `aid` from the auction table into `rec`.
+* Returns 0 on success and -1 if the table has no record of the auction
+*/
+int fs_store_read_auction(int aid, struct auction_record *rec) {
+    struct auction_record *entry = table_record(aid);
+    if (entry == NULL || entry->status == AUCTION_RECORD_EMPTY)
+        return -1;
+
+    *rec = *entry;
+    return 0;
+}
+
+/**
+* Writes the record of the auction with `aid` into the auction table
+*/
+void fs_store_write_auction(int aid, struct auction_record *rec) {
+    struct auction_record *entry = table_record(aid);
+    if (entry != NULL)
+        *entry = *rec;
+}
+
+/**
+* Get the record of the auction with `aid` in the auction table, NULL if the
+* table has no room for it
+*/
+struct auction_record *table_record(int aid) {
+    if (aid <= 0 || aid >= table_records)
+        return NULL;
+
+    return &auction_table[aid];
+}
+
+/**
+* Opens one of the directories in the database root. Returns its file descriptor
+* and -1 on failure
+*/
+int open_root_dir(char *path) {
+    int fd;
+    if ((fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) {
+        LOG_ERROR("[DB] Failed opening %s directory", path);
+        LOG_ERROR("[DB] open: %s", strerror(errno));
+    }
+
+    return fd;
+}
+
+/**
+* Gets a descriptor of the directory `path`, relative to `parent_fd`, from the
+* slot of `key` in the cache, opening it on a miss. Returns the descriptor and -1
+* on failure. It must be given back with put_dir()
+*/
+int get_dir(int key, int parent_fd, char *path, struct dir_handle **handle) {
+    struct dir_handle *entry = &dir_cache[key % FS_DIR_CACHE_SZ];
+
+    pthread_mutex_lock(&dir_cache_mutex);
+    if (entry->fd >= 0 && entry->key == key) {
+        entry->refs++;
+        pthread_mutex_unlock(&dir_cache_mutex);
+        *handle = entry;
+        return entry->fd;
+    }
+    pthread_mutex_unlock(&dir_cache_mutex);
+
+    // miss, the directory is opened without the cache locked
+    int fd;
+    if ((fd = openat(parent_fd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) {
+        LOG_DEBUG("[DB] openat %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    *handle = NULL;
+    pthread_mutex_lock(&dir_cache_mutex);
+    if (entry->refs == 0) {
+        if (entry->fd >= 0)
+            close(entry->fd);
+
+        entry->key = key;
+        entry->fd = fd;
+        entry->refs = 1;
+        *handle = entry;
+    }
+    pthread_mutex_unlock(&dir_cache_mutex);
+
+    return fd;
+}
+
+int get_user_dir(char *uid, struct dir_handle **handle) {
+    char user_dir[8];
+    sprintf(user_dir, "%.6s", uid);
+    return get_dir(atoi(user_dir) * 2, users_fd, user_dir, handle);
+}
+
+int get_auction_dir(int aid, struct dir_handle **handle) {
+    char auc_dir[32];
+    auction_subdir(aid, auc_dir);
+    return get_dir(aid * 2 + 1, auctions_fd, auc_dir, handle);
+}
+
+/**
+* Gives back a directory descriptor from get_dir(), directories that didn't fit
+* in the cache are closed
+*/
+void put_dir(int fd, struct dir_handle *handle) {
+    if (handle == NULL) {
+        close(fd);
+        return;
+    }
+
+    pthread_mutex_lock(&dir_cache_mutex);
+    handle->refs--;
+    pthread_mutex_unlock(&dir_cache_mutex);
+}
+
+/**
+* Removes the regular files in the directory `path`, relative to `at_fd`
+*/
+void remove_files(int at_fd, char *path) {
+    int fd;
+    DIR *dp;
+    struct dirent *cur;
+    if ((fd = openat(at_fd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+        return;
+
+    if ((dp = fdopendir(fd)) == NULL) {
+        LOG_DEBUG("[DB] fdopendir: %s", strerror(errno));
+        close(fd);
+        return;
+    }
+
+    while ((cur = readdir(dp)) != NULL) {
+        if (cur->d_name[0] == '.' || cur->d_type != DT_REG) continue;
+
+        if (unlinkat(fd, cur->d_name, 0) != 0) {
+            LOG_DEBUG("[DB] Couldn't remove file %s on rollback action, database might be corrupted", cur->d_name);
+            LOG_DEBUG("[DB] unlinkat: %s", strerror(errno));
+        }
+    }
+
+    if (closedir(dp) != 0) {
+        LOG_DEBUG("[DB] Failed closing file descriptor, resources may be leaking");
+        LOG_DEBUG("[DB] closedir: %s", strerror(errno));
+    }
+}
+
+/**
+* Creates an empty file in the directory `at_fd` if it doesn't exist
+*/
+int touch_file(int at_fd, char *path) {
+    int fd;
+    if ((fd = openat(at_fd, path, O_CREAT | O_CLOEXEC, SERVER_MODE)) < 0) {
+        LOG_DEBUG("[DB] openat: %s", strerror(errno));
+        return -1;
+    }
+
+    if (close(fd) != 0) {
+        LOG_DEBUG("[DB] Failed closing file descriptor, resources might be leaking");
+        LOG_DEBUG("[DB] close: %s", strerror(errno));
+    }
+
+    return 0;
+}
+
+/**
+* Replaces the content of the file `path` in the directory `at_fd`, creating it
+* if it doesn't exist
+*/
+int write_file(int at_fd, char *path, char *content) {
+    int fd;
+    if ((fd = openat(at_fd, path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, FILE_MODE)) < 0) {
+        LOG_DEBUG("[DB] openat: %s", strerror(errno));
+        return -1;
+    }
+
+    ssize_t len = strlen(content);
+    if (write(fd, content, len) != len) {
+        LOG_DEBUG("[DB] write: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    if (close(fd) != 0) {
+        LOG_DEBUG("[DB] close: %s", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
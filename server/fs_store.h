@@ -0,0 +1,60 @@
+#ifndef __FS_STORE_H__
+#define __FS_STORE_H__
+
+#include <stdint.h>
+
+/**
+* Record of an auction in DB_AUCTION_TABLE_FILE, the auction with AID `aid` is
+* the record at offset aid * sizeof(struct auction_record). Its START and END
+* files are still written, for the tools that read the directory layout
+*/
+typedef enum {
+    AUCTION_RECORD_EMPTY,   // no auction, or one written before the table existed
+    AUCTION_RECORD_OPEN,
+    AUCTION_RECORD_ENDED,
+} auction_record_status_t;
+
+struct auction_record {
+    char uid[8];
+    char name[16];
+    char fname[32];
+    int32_t start_value;
+    int32_t time_active;
+    int64_t start_time;                 // UNIX timestamp of the auction start
+    int64_t end_time;                   // UNIX timestamp of the auction end, 0 until it ends
+    int32_t status;                     // auction_record_status_t
+    int32_t top_bid;                    // highest bid value, 0 if there are no bids
+    char top_bidder[8];
+};
+
+/**
+* Persistence of the database in the ASDIR directory layout. Once the server is
+* running, the files and table records of users and auctions are only written by
+* the write-behind writer thread, in commit order, without database locks; before
+* that, loading and exporting write them from a single thread. Request threads
+* only create and remove the directory and asset of the auction they open, under
+* the catalog lock, before its record is committed. Files are reached relative to
+* cached descriptors of their user or auction directory, shared under their own
+* mutex
+*/
+int fs_store_init();
+int fs_store_open_table(int max_aid);
+void fs_store_sync();
+
+int fs_store_register(char *uid, char *passwd);
+int fs_store_unregister(char *uid);
+int fs_store_login(char *uid);
+int fs_store_logout(char *uid);
+
+void fs_store_auction_dir(int aid, char *buff);
+int fs_store_create_auction(int aid);
+void fs_store_remove_auction(int aid);
+int fs_store_move_asset(int aid, char *staging_path, char *fname);
+int fs_store_open_asset(int aid, char *fname, long *size);
+int fs_store_open(int aid, char *uid, char *name, char *fname, int sv, int ta, char *start_datetime, long start_time);
+int fs_store_bid(int aid, char *uid, int value, char *bid_datetime, long bid_sec_time);
+int fs_store_end(int aid, char *end_datetime, long end_sec_time);
+int fs_store_read_auction(int aid, struct auction_record *rec);
+void fs_store_write_auction(int aid, struct auction_record *rec);
+
+#endif
@@ -7,27 +7,34 @@
 #include <errno.h>
 
 
+#include "../utils/constants.h"
 #include "../utils/logging.h"
 #include "../utils/validators.h"
 #include "../utils/config.h"
 
 #include "server.h"
+#include "database.h"
 
 /**
 * Print program's help message
 */
 void print_usage() {
     char *usage_fmt = 
-        "usage: ./AS [-h] [-v] [-p ASport] [-o log_file]\n\n"
+        "usage: ./AS [-h] [-v] [-p ASport] [-o log_file] [-b engine] [-s level] [-e] [-x]\n\n"
 
         "options:\n"
         "  -h,          show this message and exit\n"
         "  -v,          set log level to verbose\n"
         "  -d,          set log level to debug\n"
         "  -p ASport,   port where the server will be listening (default: %s)\n"
-        "  -o log_file, set log file (default: stdout and stderr)\n";
-
-    fprintf(stdout, usage_fmt,  DEFAULT_PORT);
+        "  -o log_file, set log file (default: stdout and stderr)\n"
+        "  -b engine,   database storage engine, fs, log or mem (default: fs)\n"
+        "  -s level,    durability of the log engine, none, group or strict (default: group),\n"
+        "               ignored by the fs and mem engines\n"
+        "  -e,          export the log engine database to the fs layout and exit\n"
+        "  -x,          extended AIDs, up to %d auctions with AIDs of up to %d digits\n";
+
+    fprintf(stdout, usage_fmt,  DEFAULT_PORT, MAX_EXT_AUCTIONS, EXT_AID_SIZE);
 }
 
 
@@ -36,9 +43,14 @@ int main(int argc, char **argv) {
     log_level_t g_level = LOG_NORMAL;
     char *port = DEFAULT_PORT;
     char *log_file = NULL;
+    db_engine_t engine = DB_ENGINE_FS;
+    db_durability_t durability = DB_DURABILITY_GROUP;
+    char *durability_arg = NULL;
+    int export = 0;
+    int extended_aids = 0;
 
     int opt = 0; 
-    while ((opt = getopt(argc, argv, "hdvp:o:")) != -1) { 
+    while ((opt = getopt(argc, argv, "hdvp:o:b:s:ex")) != -1) { 
         switch (opt) {
             case 'h':
                 print_usage();
@@ -66,6 +78,39 @@ int main(int argc, char **argv) {
                 log_file = optarg;
                 break;
 
+            case 'b':
+                if (strcmp(optarg, "fs") == 0) {
+                    engine = DB_ENGINE_FS;
+                } else if (strcmp(optarg, "log") == 0) {
+                    engine = DB_ENGINE_LOG;
+                } else if (strcmp(optarg, "mem") == 0) {
+                    engine = DB_ENGINE_MEM;
+                } else {
+                    LOG_WARN("Ignoring invalid -b argument: %s", optarg);
+                }
+                break;
+
+            case 's':
+                durability_arg = optarg;
+                if (strcmp(optarg, "none") == 0) {
+                    durability = DB_DURABILITY_NONE;
+                } else if (strcmp(optarg, "group") == 0) {
+                    durability = DB_DURABILITY_GROUP;
+                } else if (strcmp(optarg, "strict") == 0) {
+                    durability = DB_DURABILITY_STRICT;
+                } else {
+                    LOG_WARN("Ignoring invalid -s argument: %s", optarg);
+                }
+                break;
+
+            case 'e':
+                export = 1;
+                break;
+
+            case 'x':
+                extended_aids = 1;
+                break;
+
             default:
                 // this is an error
                 print_usage();
@@ -101,7 +146,23 @@ int main(int argc, char **argv) {
         };
     }
 
+    if (extended_aids) {
+        set_database_extended_aids();
+    }
+
+    set_database_durability(durability);
+
+    if (export) {
+        exit(export_database() == 0 ? 0 : 1);
+    }
+
+    // the FS engine acknowledges changes once they are queued for its writer
+    if (durability_arg != NULL && engine != DB_ENGINE_LOG) {
+        LOG_WARN("Ignoring -s %s, only the log engine syncs changes before acknowledging them", durability_arg);
+    }
+
     // call server(port) here
+    set_database_engine(engine);
     server(port);
     exit(0);
 }
\ No newline at end of file
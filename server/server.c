@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
 
@@ -11,6 +12,10 @@
 
 #include <signal.h>
 #include <pthread.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 #include "../utils/logging.h"
 #include "../utils/config.h"
@@ -23,7 +28,46 @@
 #include "tcp.h"
 
 /**
-* Main UDP socket serving loop
+* Buffers of a batch of UDP requests and of their responses. The response to
+* request i is sent back to the address it came from, addrs[i]
+*/
+struct udp_batch {
+    struct mmsghdr recv_msgs[UDP_BATCH];
+    struct mmsghdr send_msgs[UDP_BATCH];
+    struct iovec recv_iovs[UDP_BATCH];
+    struct iovec send_iovs[UDP_BATCH];
+    struct sockaddr_in addrs[UDP_BATCH];
+    char recv_buffers[UDP_BATCH][UDP_REQUEST_SIZE + 1];
+    char send_buffers[UDP_BATCH][UDP_DATAGRAM_SIZE];
+};
+
+void serve_udp_datagram(char *request, ssize_t len, int truncated, struct sockaddr_in *client_addr,
+                            char **response, size_t *response_size);
+
+/**
+* Cost of serving UDP requests, from the moment a batch is received until its
+* responses are sent
+*/
+static unsigned long udp_requests;
+static unsigned long udp_cycles;
+
+/**
+* Reads the CPU timestamp counter, or the monotonic clock in nanoseconds where
+* there is none
+*/
+static inline unsigned long read_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000UL + now.tv_nsec;
+#endif
+}
+
+/**
+* Main UDP socket serving loop. Every UDP server thread has its own socket bound
+* to the port with SO_REUSEPORT, and the kernel spreads the datagrams among them
 */
 void *udp_server_thread_fn(void *thread_v) {
     thread_t *thread = thread_v;
@@ -33,8 +77,7 @@ void *udp_server_thread_fn(void *thread_v) {
     * Set socket for UDP server
     */
     int udp_sock;
-    struct sockaddr_in client_addr, server_addr;
-    socklen_t client_addr_size = sizeof(client_addr);
+    struct sockaddr_in server_addr;
 
     // initialize UDP socket
     if ((udp_sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
@@ -43,6 +86,13 @@ void *udp_server_thread_fn(void *thread_v) {
         exit(1);
     }
 
+    int reuse = 1;
+    if (setsockopt(udp_sock, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) != 0) {
+        LOG_ERROR("Failed setting UDP socket options");
+        LOG_ERROR("setsockopt: %s", strerror(errno));
+        exit(1);
+    }
+
     server_addr.sin_family      = AF_INET;
     // atoi converts string to int, htons converts int bytes in C to bytes in network notation (big endian) 
     server_addr.sin_port        = htons(atoi(port));
@@ -54,86 +104,143 @@ void *udp_server_thread_fn(void *thread_v) {
         exit(1);
     }
 
-    LOG("[UDP] Serving UDP connections on port %s", port);
+    if (thread->thread_nr == 0)
+        LOG("[UDP] Serving UDP connections on port %s with %d threads", port, UDP_THREADS);
 
     /**
-    * Main loop for UDP server 
+    * Main loop for UDP server. Up to UDP_BATCH datagrams are received with one
+    * recvmmsg(), which waits for the first one and takes the rest only if they
+    * already arrived, so a lone request isn't delayed. Their responses are sent
+    * together with one sendmmsg()
     */
-    struct udp_client udp_client;
-    char client_ipv4[INET_ADDRSTRLEN];
+    struct udp_batch *batch;
+    if ((batch = malloc(sizeof(struct udp_batch))) == NULL) {
+        LOG_ERROR("Failed allocating UDP buffers");
+        exit(1);
+    }
+
+    memset(batch->recv_msgs, 0, sizeof(batch->recv_msgs));
+    memset(batch->send_msgs, 0, sizeof(batch->send_msgs));
+    for (int i = 0; i < UDP_BATCH; ++i) {
+        batch->recv_iovs[i].iov_base = batch->recv_buffers[i];
+        batch->recv_iovs[i].iov_len = UDP_REQUEST_SIZE;
+        batch->recv_msgs[i].msg_hdr.msg_iov = &batch->recv_iovs[i];
+        batch->recv_msgs[i].msg_hdr.msg_iovlen = 1;
+        batch->recv_msgs[i].msg_hdr.msg_name = &batch->addrs[i];
+
+        batch->send_iovs[i].iov_base = batch->send_buffers[i];
+        batch->send_msgs[i].msg_hdr.msg_iov = &batch->send_iovs[i];
+        batch->send_msgs[i].msg_hdr.msg_iovlen = 1;
+        batch->send_msgs[i].msg_hdr.msg_name = &batch->addrs[i];
+    }
 
-    char recv_buffer[UDP_DATAGRAM_SIZE]; // to where we read requests 
-    char send_buffer[UDP_DATAGRAM_SIZE]; // where responses are stored before sending
-    size_t response_size;
     while (1) {
-        memset(recv_buffer, 0, sizeof(recv_buffer));
-        memset(send_buffer, 0, sizeof(send_buffer));
-        memset(&udp_client, 0, sizeof(struct udp_client));
-        memset(&client_addr, 0, sizeof(client_addr));
+        for (int i = 0; i < UDP_BATCH; ++i)
+            batch->recv_msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
 
-        ssize_t read = recvfrom(udp_sock, recv_buffer, sizeof(recv_buffer), 0, (struct sockaddr*)&client_addr, &client_addr_size);
-        if (read < 0) {
+        int n = recvmmsg(udp_sock, batch->recv_msgs, UDP_BATCH, MSG_WAITFORONE, NULL);
+        if (n < 0) {
             LOG_DEBUG("[UDP] Failed reading from socket");
-            LOG_ERROR("[UDP] recvfrom: %s", strerror(errno));
+            LOG_ERROR("[UDP] recvmmsg: %s", strerror(errno));
             continue;
         }
 
-        // copy ipv4 string into client_ipv4 string variable
-        inet_ntop(AF_INET, &client_addr.sin_addr, client_ipv4, INET6_ADDRSTRLEN);
-        // initialize client struct
-        strcpy(udp_client.ipv4, client_ipv4);
-        udp_client.port = htons(client_addr.sin_port);
+        unsigned long start = read_cycles();
+        for (int i = 0; i < n; ++i) {
+            struct msghdr *req = &batch->recv_msgs[i].msg_hdr;
+            char *response = batch->send_buffers[i];
+            size_t response_size;
+            serve_udp_datagram(batch->recv_buffers[i], batch->recv_msgs[i].msg_len,
+                                req->msg_flags & MSG_TRUNC, &batch->addrs[i],
+                                &response, &response_size);
+
+            // the response may be a cached one instead of the send buffer
+            batch->send_iovs[i].iov_base = response;
+            batch->send_iovs[i].iov_len = response_size;
+            batch->send_msgs[i].msg_hdr.msg_namelen = req->msg_namelen;
+        }
 
         /**
-        * Perform basic message validation
+        * Respond to the clients, a reply that can't be sent is dropped like
+        * a lost datagram
         */
-        if (read == 0) {
-            LOG_VERBOSE("%s:%d - [UDP] Empty message received", udp_client.ipv4, udp_client.port);
-            if (sendto(udp_sock, "ERR\n", 4, 0, (struct sockaddr *)&client_addr, client_addr_size) < 0) {
-                LOG_DEBUG("[UDP] Failed responding to client...");
-                LOG_ERROR("[UDP] sendto: %s", strerror(errno))
+        int sent = 0;
+        while (sent < n) {
+            int ret = sendmmsg(udp_sock, batch->send_msgs + sent, n - sent, 0);
+            if (ret < 0) {
+                LOG_DEBUG("[UDP] Failed responding to client");
+                LOG_ERROR("sendmmsg: %s", strerror(errno))
+                ret = 1;
             }
-            continue;
-        }
 
-         // check for messages too long (for the current protocol) 
-        if (read > 20) {
-            LOG_VERBOSE("%s:%d - [UDP] Ignoring too long message", udp_client.ipv4, udp_client.port);
-            if (sendto(udp_sock, "ERR\n", 4, 0, (struct sockaddr *)&client_addr, client_addr_size) < 0) {
-                LOG_DEBUG("[UDP] Failed responding to client...");
-                LOG_ERROR("[UDP] sendto: %s", strerror(errno))
-            }
-            continue;
+            sent += ret;
         }
+        release_udp_responses();
 
-        // check for message not ending in \n 
-        if (recv_buffer[read - 1] != '\n') {
-            LOG_VERBOSE("%s:%d - [UDP] Ignoring badly formatted message", udp_client.ipv4, udp_client.port);
-            if (sendto(udp_sock, "ERR\n", 4, 0, (struct sockaddr *)&client_addr, client_addr_size) < 0) {
-                LOG_DEBUG("[UDP] Failed responding to client...");
-                LOG_ERROR("sendto: %s", strerror(errno))
-            }
-            continue;
-        }
+        __atomic_add_fetch(&udp_cycles, read_cycles() - start, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&udp_requests, n, __ATOMIC_RELAXED);
+    }
+}
 
-        /**
-        * Handle the request 
-        */
-        LOG_VERBOSE("%s:%d - [UDP] Serving client", udp_client.ipv4, udp_client.port);
+/**
+* Logs how many UDP requests were served and the average cycles each one took
+*/
+void log_udp_stats() {
+    unsigned long requests = __atomic_load_n(&udp_requests, __ATOMIC_RELAXED);
+    unsigned long cycles = __atomic_load_n(&udp_cycles, __ATOMIC_RELAXED);
 
-        int err = handle_udp_command(recv_buffer, &udp_client, send_buffer, &response_size);
-        if (err) { // the message didn't pass further validation steps 
-            strcpy(send_buffer, "ERR\n");
-            response_size = 4;
-        }
+    LOG("[UDP] %lu requests served, %lu cycles per request", requests, requests ? cycles / requests : 0);
+}
 
-        /**
-        * Respond to client
-        */
-        if (sendto(udp_sock, send_buffer, response_size, 0, (struct sockaddr *)&client_addr, client_addr_size) < 0) {
-            LOG_DEBUG("%s:%d - [UDP] Failed responding to client", udp_client.ipv4, udp_client.port);
-            LOG_ERROR("sendto: %s", strerror(errno))
-        }
+/**
+* Validates a UDP request of `len` bytes and handles it, writing the response
+* into *response, which holds UDP_DATAGRAM_SIZE bytes, or pointing it to a cached
+* response. Requests too long for the protocol, `truncated` ones included, are
+* answered with ERR.
+*
+* Neither buffer is cleared beforehand: the request is terminated after its
+* `len` bytes and only the first `response_size` bytes of the response are sent
+*/
+void serve_udp_datagram(char *request, ssize_t len, int truncated, struct sockaddr_in *client_addr,
+                            char **response, size_t *response_size) {
+    struct udp_client udp_client;
+    inet_ntop(AF_INET, &client_addr->sin_addr, udp_client.ipv4, INET_ADDRSTRLEN);
+    udp_client.port = htons(client_addr->sin_port);
+
+    memcpy(*response, "ERR\n", 4);
+    *response_size = 4;
+
+    /**
+    * Perform basic message validation
+    */
+    if (len == 0) {
+        LOG_VERBOSE("%s:%d - [UDP] Empty message received", udp_client.ipv4, udp_client.port);
+        return;
+    }
+
+    // check for messages too long (for the current protocol) 
+    if (len > UDP_REQUEST_SIZE || truncated) {
+        LOG_VERBOSE("%s:%d - [UDP] Ignoring too long message", udp_client.ipv4, udp_client.port);
+        return;
+    }
+
+    request[len] = '\0';
+
+    // check for message not ending in \n 
+    if (request[len - 1] != '\n') {
+        LOG_VERBOSE("%s:%d - [UDP] Ignoring badly formatted message", udp_client.ipv4, udp_client.port);
+        return;
+    }
+
+    /**
+    * Handle the request 
+    */
+    LOG_VERBOSE("%s:%d - [UDP] Serving client", udp_client.ipv4, udp_client.port);
+
+    int err = handle_udp_command(request, &udp_client, response, response_size);
+    if (err) { // the message didn't pass further validation steps 
+        memcpy(*response, "ERR\n", 4);
+        *response_size = 4;
     }
 }
 
@@ -185,7 +292,7 @@ void *tcp_server_thread_fn(void *thread_v) {
     */
     struct tcp_client tcp_client;
     char client_ipv4[INET_ADDRSTRLEN];
-    char conn_fd;
+    int conn_fd;
 
     struct sockaddr_in client_addr;
     socklen_t client_addr_size = sizeof(client_addr);
@@ -242,7 +349,76 @@ void *tcp_worker_thread_fn(void *arg) {
 }
 
 
+/**
+* Logs the database statistics every time the server receives SIGUSR1. On SIGINT
+* or SIGTERM it waits for the database to write every change and exits
+*/
+void *stats_thread_fn(void *arg) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+
+    int sig;
+    while (1) {
+        if (sigwait(&set, &sig) != 0) {
+            LOG_DEBUG("Failed waiting for signals");
+            continue;
+        }
+
+        if (sig != SIGUSR1) {
+            LOG("Shutting down");
+            close_database();
+            fflush(stdout);
+            exit(0);
+        }
+
+        log_udp_stats();
+        log_db_stats();
+        fflush(stdout); // the log might be redirected to a file
+    }
+}
+
+/**
+* Writes a snapshot of the database every time enough changes were logged
+*/
+void *checkpoint_thread_fn(void *arg) {
+    while (1) {
+        wait_checkpoint();
+
+        if (checkpoint_database() != 0) {
+            LOG_ERROR("Failed writing database checkpoint");
+        }
+    }
+}
+
+/**
+* Closes every auction when its deadline is reached
+*/
+void *closer_thread_fn(void *arg) {
+    while (1) {
+        if (close_expired_auctions() != 0) {
+            LOG_ERROR("Failed closing expired auctions");
+        }
+
+        wait_expiry();
+    }
+}
+
 void server(char *port) {
+    // signals are only handled by the stats thread, every thread, database
+    // threads included, inherits this mask
+    sigset_t stats_set;
+    sigemptyset(&stats_set);
+    sigaddset(&stats_set, SIGUSR1);
+    sigaddset(&stats_set, SIGINT);
+    sigaddset(&stats_set, SIGTERM);
+    if (pthread_sigmask(SIG_BLOCK, &stats_set, NULL) != 0) {
+        LOG_ERROR("Failed blocking signals");
+        exit(1);
+    }
+
     // initialize database
     if (init_database() != 0) {
         LOG_ERROR("Failed initializing database");
@@ -258,14 +434,35 @@ void server(char *port) {
         
     /**
     * Launch all server threads. 
-    * 1 thread receiving and responding to UDP messages 
+    * UDP_THREADS threads receiving and responding to UDP messages
     * 1 thread accepting TCP connections
     * 30 threads handling TCP connections (THREAD_POOL_SIZE = 20)
+    * 1 thread logging statistics on SIGUSR1 and shutting down on SIGINT and SIGTERM
+    * 1 thread writing database snapshots
+    * 1 thread closing auctions when they expire
     */
-    thread_t udp_thread;
+    thread_t udp_threads[UDP_THREADS];
     thread_t tcp_thread;
+    thread_t stats_thread;
+    thread_t checkpoint_thread;
+    thread_t closer_thread;
     thread_t worker_threads[THREAD_POOL_SZ];
 
+    if (pthread_create(&stats_thread.tid, NULL, stats_thread_fn, (void *)&stats_thread) != 0) {
+        LOG_ERROR("Failed creating stats thread");
+        exit(1);
+    }
+
+    if (pthread_create(&checkpoint_thread.tid, NULL, checkpoint_thread_fn, (void *)&checkpoint_thread) != 0) {
+        LOG_ERROR("Failed creating checkpoint thread");
+        exit(1);
+    }
+
+    if (pthread_create(&closer_thread.tid, NULL, closer_thread_fn, (void *)&closer_thread) != 0) {
+        LOG_ERROR("Failed creating auction closer thread");
+        exit(1);
+    }
+
     tasks_queue *tasks_q; // producer consumer queue
     //  producer consumer queue
     if (init_queue(&tasks_q) != 0) {
@@ -283,11 +480,14 @@ void server(char *port) {
         };
     }
 
-    // launch UDP server thread
-    udp_thread.args = port;
-    if (pthread_create(&udp_thread.tid, NULL, udp_server_thread_fn, (void *)&udp_thread)) {
-        LOG_ERROR("Failed creating UDP server thread");
-        exit(1);
+    // launch UDP server threads
+    for (int i = 0; i < UDP_THREADS; i++) {
+        udp_threads[i].thread_nr = i;
+        udp_threads[i].args = port;
+        if (pthread_create(&udp_threads[i].tid, NULL, udp_server_thread_fn, (void *)&udp_threads[i])) {
+            LOG_ERROR("Failed creating UDP server thread");
+            exit(1);
+        }
     }
 
     // launch TCP server thread
@@ -305,9 +505,11 @@ void server(char *port) {
     /** 
     * Block here forever, no exit mechanism was specified 
     */
-    if (pthread_join(udp_thread.tid, NULL) != 0) {
-        LOG_ERROR("Failed joining UDP server thread");
-        exit(1);
+    for (int i = 0; i < UDP_THREADS; i++) {
+        if (pthread_join(udp_threads[i].tid, NULL) != 0) {
+            LOG_ERROR("Failed joining UDP server thread");
+            exit(1);
+        }
     }
 
     if (pthread_join(tcp_thread.tid, NULL) != 0) {
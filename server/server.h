@@ -5,6 +5,7 @@
 #include <unistd.h>
 
 #define UDP_DATAGRAM_SIZE 65535
+#define UDP_REQUEST_SIZE 20 // longest request of the UDP protocol
 
 struct udp_client {
     char ipv4[INET_ADDRSTRLEN];
@@ -4,6 +4,7 @@
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
+#include <ctype.h>
 #include <fcntl.h>
 #include <sys/sendfile.h>
 #include <sys/stat.h>
@@ -14,12 +15,14 @@
 #include "../utils/validators.h"
 #include "../utils/utils.h"
 
+#include "fs_store.h"
 #include "server.h"
 #include "tcp_command_table.h"
 #include "database.h"
 #include "tcp.h"
 
 int is_valid_opa_arg(char *arg, int argno);
+int read_extended_aid(char *aid_end, char delim, int conn_fd);
 /**
 * Serve a TCP connection
 */
@@ -166,7 +169,8 @@ int handle_open(struct tcp_client *client) {
         return OPA_BAD_ARGS;
     }
 
-    uid = strtok(buff, " ");
+    char *save;
+    uid = strtok_r(buff, " ", &save);
     if (uid == NULL) {
         LOG_VERBOSE("%s:%d - [OPA] No UID", client->ipv4, client->port);
         return OPA_BAD_ARGS;
@@ -176,7 +180,7 @@ int handle_open(struct tcp_client *client) {
         return OPA_BAD_ARGS;
     }
 
-    passwd = strtok(NULL, " ");
+    passwd = strtok_r(NULL, " ", &save);
     if (passwd == NULL) {
         LOG_VERBOSE("%s:%d - [OPA] No password", client->ipv4, client->port);
         return OPA_BAD_ARGS;
@@ -257,10 +261,12 @@ int handle_open(struct tcp_client *client) {
     }
 
     /**
-    * Make database validations
+    * Create the auction, the user is validated by the database
     */
-    if (!exists_user(uid) || !is_user_logged_in(uid)) {
-        LOG_VERBOSE("%s:%d - [OPA] User %s doesn't exist or is not logged in", client->ipv4, client->port, uid);
+    int auction_id;
+    db_status_t status = db_open_auction(uid, passwd, name, fname, sv, ta, fsize, client->conn_fd, &auction_id);
+    if (status == DB_NO_USER || status == DB_NOT_LOGGED_IN) {
+        LOG_VERBOSE("%s:%d - [OPA] User %s doesn't exist, is not logged in or failed authentication", client->ipv4, client->port, uid);
         char *resp = "ROA NLG\n";
         if (send_tcp_message(resp, 8, client->conn_fd) != 0) {
             LOG_VERBOSE("%s:%d - [OPA] Failed responding ROA NLG", client->ipv4, client->port);
@@ -270,20 +276,7 @@ int handle_open(struct tcp_client *client) {
         return 0;
     }
 
-    if (!is_authentic_user(uid, passwd)) {
-        LOG_VERBOSE("%s:%d - [OPA] Authentication failed for user %s", client->ipv4, client->port, uid);
-        char *resp = "ROA NLG\n";
-        if (send_tcp_message(resp, 8, client->conn_fd) != 0) {
-            LOG_VERBOSE("%s:%d - [OPA] Failed responding ROA NLG", client->ipv4, client->port);
-            if (errno == EPIPE)
-                LOG_VERBOSE("%s:%d - [OPA] Connection closed by client", client->ipv4, client->port);
-        }
-        return 0;
-    }
-
-    // create new auction
-    int auction_id = create_new_auction(uid, name, fname, sv, ta, fsize, client->conn_fd);
-    if (auction_id == -1) {
+    if (status != DB_OK) {
         LOG_VERBOSE("%s:%d - [OPA] Failed creating new auction", client->ipv4, client->port);
 
         if (errno == EAGAIN || errno == EWOULDBLOCK)
@@ -301,9 +294,9 @@ int handle_open(struct tcp_client *client) {
     /**
     * Respond to client
     */
-    char resp[12];
+    char resp[16];
     sprintf(resp, "ROA OK %03d\n", auction_id);
-    if (send_tcp_message(resp, 11, client->conn_fd) != 0) {
+    if (send_tcp_message(resp, strlen(resp), client->conn_fd) != 0) {
         LOG_VERBOSE("%s:%d - [OPA] Failed responding ROA OK", client->ipv4, client->port);
         if (errno == EPIPE)
             LOG_VERBOSE("%s:%d - [OPA] Client closed connection", client->ipv4, client->port);
@@ -338,7 +331,7 @@ int handle_close(struct tcp_client *client) {
     /**
     * Validate message format
     */
-    if (buff[UID_SIZE + PASSWORD_SIZE + AID_SIZE + 2] != '\n') {
+    if (read_extended_aid(&buff[UID_SIZE + PASSWORD_SIZE + AID_SIZE + 2], '\n', client->conn_fd) != 0) {
         LOG_VERBOSE("%s:%d - [CLS] Bad end token for command", client->ipv4, client->port);
         return CLS_BAD_ARGS;
     }
@@ -346,9 +339,10 @@ int handle_close(struct tcp_client *client) {
     /**
     * Validate message arguments
     */
-    char *uid = strtok(buff, " "); 
-    char *passwd = strtok(NULL, " ");
-    char *aid = strtok(NULL, "\n");
+    char *save;
+    char *uid = strtok_r(buff, " ", &save); 
+    char *passwd = strtok_r(NULL, " ", &save);
+    char *aid = strtok_r(NULL, "\n", &save);
 
     if (uid == NULL) {
         LOG_VERBOSE("%s:%d - [CLS] No UID", client->ipv4, client->port);
@@ -375,86 +369,48 @@ int handle_close(struct tcp_client *client) {
         return CLS_BAD_ARGS;
     }
 
-    if (!is_valid_aid(aid)) {
+    if (!is_valid_extended_aid(aid, get_aid_size())) {
         LOG_VERBOSE("%s:%d - [CLS] Invalid AID", client->ipv4, client->port);
         return CLS_BAD_ARGS;
     }
 
-    // Update database /
-    update_database();
-    /*
-    * Validate user and auction in database 
+    /**
+    * Handle the CLS command, the user and auction are validated by the database
     */
-    // check user against db
-    if (!exists_user(uid) || !is_user_logged_in(uid) || !is_authentic_user(uid, passwd)) {
-        LOG_VERBOSE("%s:%d - [CLS] User %s doesn't exist or is not logged in", client->ipv4, client->port, uid);
-        char *resp = "RCL NLG\n";
-        if (send_tcp_message(resp, 8, client->conn_fd) != 0) {
-            LOG_VERBOSE("%s:%d - [CLS] Failed responding RCL NLG", client->ipv4, client->port);
-            if (errno == EPIPE)
-                LOG_VERBOSE("%s:%d - [CLS] Client closed connection", client->ipv4, client->port);
-        }
-        return 0;
-    }
+    char *resp = NULL;
+    switch (db_close_auction(aid, uid, passwd)) {
+        case DB_OK:
+            break;
 
-    // check if auction exists
-    if (!exists_auction(aid)) {
-        LOG_VERBOSE("%s:%d - [CLS] Auction %s doesn't exist", client->ipv4, client->port, aid);
-        char *resp = "RCL EAU\n";
-        if (send_tcp_message(resp, 8, client->conn_fd) != 0) {
-            LOG_VERBOSE("%s:%d - [CLS] Failed responding RCL EAU", client->ipv4, client->port);
-            if (errno == EPIPE)
-                LOG_VERBOSE("%s:%d - [CLS] Client closed connection", client->ipv4, client->port);
-        }
-        return 0;
-    }
+        case DB_NOT_LOGGED_IN:
+            LOG_VERBOSE("%s:%d - [CLS] User %s doesn't exist or is not logged in", client->ipv4, client->port, uid);
+            resp = "RCL NLG\n";
+            break;
 
-    // read auction information 
-    char auction_info[256];
-    if (get_auction_info(aid, auction_info, 256) != 0) {
-        LOG_VERBOSE("%s:%d - [CLS] Failed retrieving information about action %s", client->ipv4, client->port, aid);
-        char *resp = "RCL NOK\n";
-        if (send_tcp_message(resp, 8, client->conn_fd) != 0) {
-            LOG_VERBOSE("%s:%d - [CLS] Failed responding RCL NOK", client->ipv4, client->port);
-            if (errno == EPIPE)
-                LOG_VERBOSE("%s:%d - [CLS] Client closed connection", client->ipv4, client->port);
-        }
-        return 0;
-    }
+        case DB_NO_AUCTION:
+            LOG_VERBOSE("%s:%d - [CLS] Auction %s doesn't exist", client->ipv4, client->port, aid);
+            resp = "RCL EAU\n";
+            break;
 
-    // check if user is the owner of desired auction
-    char *owner_uid = strtok(auction_info, " ");
-    if (strcmp(owner_uid, uid) != 0) {
-        LOG_VERBOSE("%s:%d - [CLS] Invalid owner for auction %s", client->ipv4, client->port, aid);
-        char *resp = "RCL EOW\n";
-        if (send_tcp_message(resp, 8, client->conn_fd) != 0) {
-            LOG_VERBOSE("%s:%d - [CLS] Failed responding RCL EOW", client->ipv4, client->port);
-            if (errno == EPIPE)
-                LOG_VERBOSE("%s:%d - [CLS] Client closed connection", client->ipv4, client->port);
-        }
-        return 0;
-    }
+        case DB_NOT_OWNER:
+            LOG_VERBOSE("%s:%d - [CLS] Invalid owner for auction %s", client->ipv4, client->port, aid);
+            resp = "RCL EOW\n";
+            break;
 
-    // check if auction is already finished
-    if (is_auction_finished(aid)) {
-        LOG_VERBOSE("%s:%d - [CLS] Auction %s has already finished", client->ipv4, client->port, aid);
-        char *resp = "RCL END\n";
-        if (send_tcp_message(resp, 8, client->conn_fd) != 0) {
-            LOG_VERBOSE("%s:%d - [CLS] Failed responding RCL END", client->ipv4, client->port);
-            if (errno == EPIPE)
-                LOG_VERBOSE("%s:%d - [CLS] Client closed connection", client->ipv4, client->port);
-        }
-        return 0;
+        case DB_AUCTION_ENDED:
+            LOG_VERBOSE("%s:%d - [CLS] Auction %s has already finished", client->ipv4, client->port, aid);
+            resp = "RCL END\n";
+            break;
+
+        default:
+            LOG_VERBOSE("%s:%d - [CLS] Auction %s couldn't be closed", client->ipv4, client->port, aid);
+            resp = "RCL NOK\n";
+            break;
     }
 
-    /**
-    * Handle the CLS command 
-    */
-    if (close_auction(aid) != 0) {
-        LOG_VERBOSE("%s:%d - [CLS] Auction %s couldn't be closed", client->ipv4, client->port, aid);
-        char *resp = "RCL NOK\n";
+    if (resp != NULL) {
         if (send_tcp_message(resp, 8, client->conn_fd) != 0) {
-            LOG_VERBOSE("%s:%d - [CLS] Failed responding RCL END", client->ipv4, client->port);
+            LOG_VERBOSE("%s:%d - [CLS] Failed responding %.7s", client->ipv4, client->port, resp);
             if (errno == EPIPE)
                 LOG_VERBOSE("%s:%d - [CLS] Client closed connection", client->ipv4, client->port);
         }
@@ -462,7 +418,7 @@ int handle_close(struct tcp_client *client) {
     }
 
     // inform user of success
-    char *resp = "RCL OK\n";
+    resp = "RCL OK\n";
     if (send_tcp_message(resp, 7, client->conn_fd) != 0) {
         LOG_VERBOSE("%s:%d - [CLS] Failed responding RCL OK", client->ipv4, client->port);
         if (errno == EPIPE)
@@ -481,7 +437,7 @@ int handle_show_asset(struct tcp_client *client) {
     /**
     * Read and validate command arguments
     */
-    char buff[8] = {0}; // enough to fit AID + null terminating byte 
+    char buff[16] = {0}; // enough to fit an extended AID + null terminating byte
     int err = read_tcp_stream(buff, AID_SIZE + 1, client->conn_fd);
     if (err) {
         LOG_VERBOSE("%s:%d - [SAS] Failed reading UID and password from TCP stream", client->ipv4, client->port);
@@ -499,18 +455,19 @@ int handle_show_asset(struct tcp_client *client) {
         return SAS_BAD_ARGS;
     }
 
-    if (buff[AID_SIZE] != '\n') {
+    if (read_extended_aid(&buff[AID_SIZE], '\n', client->conn_fd) != 0) {
         LOG_VERBOSE("%s:%d - [SAS] Bad end token", client->ipv4, client->port);
         return SAS_BAD_ARGS;
     }
 
-    aid = strtok(buff, "\n");
+    char *save;
+    aid = strtok_r(buff, "\n", &save);
     if (aid == NULL) {
         LOG_VERBOSE("%s:%d - [SAS] No AID", client->ipv4, client->port);
         return SAS_BAD_ARGS;
     }
 
-    if (!is_valid_aid(aid)) {
+    if (!is_valid_extended_aid(aid, get_aid_size())) {
         LOG_VERBOSE("%s:%d - [SAS] Invalid AID", client->ipv4, client->port);
         return SAS_BAD_ARGS;
     }
@@ -545,9 +502,9 @@ int handle_show_asset(struct tcp_client *client) {
     }
 
     // read asset file path
-    char *asset_fname = strtok(auction_info, " ");
+    char *asset_fname = strtok_r(auction_info, " ", &save);
     for (int i = 0; i < 2; ++i) {
-        asset_fname = strtok(NULL, " ");
+        asset_fname = strtok_r(NULL, " ", &save);
     }
 
     if (asset_fname == NULL) {
@@ -561,25 +518,12 @@ int handle_show_asset(struct tcp_client *client) {
         return 0;
     }
 
-    struct stat st; 
-    char asset_path[128];
-    sprintf(asset_path, "AUCTIONS/%s/ASSET/%s", aid, asset_fname);
-    if (stat(asset_path, &st) != 0) {
-        LOG_VERBOSE("%s:%d - [SAS] Failed retrieving %3s auction information", client->ipv4, client->port, aid);
-        char *resp = "RSA NOK\n"; 
-        if (send_tcp_message(resp, 8, client->conn_fd) != 0) {
-            LOG_VERBOSE("%s:%d - [SAS] Failed responding RSA NOK", client->ipv4, client->port);
-            if (errno == EPIPE)
-                LOG_VERBOSE("%s:%d - [SAS] Client closed connection", client->ipv4, client->port);
-        }
-        return 0;
-    }
-
     /**
     * Send response
     */
     int afd;
-    if ((afd = open(asset_path, O_RDONLY, 0)) < 0) {
+    long fsize;
+    if ((afd = fs_store_open_asset(atoi(aid), asset_fname, &fsize)) < 0) {
         LOG_VERBOSE("%s:%d - [SAS] Failed retrieving %3s auction information", client->ipv4, client->port, aid);
         char *resp = "RSA NOK\n"; 
         if (send_tcp_message(resp, 8, client->conn_fd) != 0) {
@@ -592,8 +536,7 @@ int handle_show_asset(struct tcp_client *client) {
     
     // send asset meta data
     char resp_info[128];
-    long fsize = st.st_size;
-    sprintf(resp_info, "RSA OK %s %ld ", asset_fname, st.st_size);
+    sprintf(resp_info, "RSA OK %s %ld ", asset_fname, fsize);
     if (send_tcp_message(resp_info, strlen(resp_info), client->conn_fd) != 0) {
         LOG_VERBOSE("%s:%d - [SAS] Failed sending asset information", client->ipv4, client->port);
         if (errno == EPIPE)
@@ -640,6 +583,11 @@ int handle_bid(struct tcp_client *client) {
         return BID_BAD_ARGS;
     }
 
+    if (read_extended_aid(&buff[UID_SIZE + PASSWORD_SIZE + AID_SIZE + 2], ' ', client->conn_fd) != 0) {
+        LOG_VERBOSE("%s:%d - [BID] Invalid AID", client->ipv4, client->port);
+        return BID_BAD_ARGS;
+    }
+
     /* read bid value (byte by byte)*/
     char byte = '0'; // byte currently reading
     char value[MAX_BID_VALUE + 1] = {0}; // overall value
@@ -683,9 +631,10 @@ int handle_bid(struct tcp_client *client) {
     /**
     * Validate message arguments
     */
-    char *uid = strtok(buff, " "); 
-    char *passwd = strtok(NULL, " ");
-    char *aid = strtok(NULL, " ");
+    char *save;
+    char *uid = strtok_r(buff, " ", &save); 
+    char *passwd = strtok_r(NULL, " ", &save);
+    char *aid = strtok_r(NULL, " ", &save);
 
     if (uid == NULL) {
         LOG_VERBOSE("%s:%d - [BID] No UID", client->ipv4, client->port);
@@ -712,130 +661,65 @@ int handle_bid(struct tcp_client *client) {
         return BID_BAD_ARGS;
     }
 
-    if (!is_valid_aid(aid)) {
+    if (!is_valid_extended_aid(aid, get_aid_size())) {
         LOG_VERBOSE("%s:%d - [BID] Invalid AID", client->ipv4, client->port);
         return BID_BAD_ARGS;
     }
 
-    // update database
-    update_database();
     /**
-    * Validate user and auction in database 
+    * Place the bid, the user, auction and bid value are validated by the database
     */
-    if (!exists_user(uid)) {
-        LOG_VERBOSE("%s:%d - [BID] User %s doesn't exist", client->ipv4, client->port, uid);
-        char *resp = "RBD NOK\n";
-        if (send_tcp_message(resp, 8, client->conn_fd) != 0) {
-            LOG_VERBOSE("%s:%d - [BID] Failed responding RBD NOK to client", client->ipv4, client->port);
-            if (errno == EPIPE)
-                LOG_VERBOSE("%s:%d - [BID] Connection closed by client", client->ipv4, client->port);
-        }
-        return 0;
-    }
-
-    // check user against db
-    if (!is_user_logged_in(uid) || !is_authentic_user(uid, passwd)) {
-        LOG_VERBOSE("%s:%d - [BID] User %s is not logged in or failed authentication", client->ipv4, client->port, uid);
-        char *resp = "RBD NLG\n";
-        if (send_tcp_message(resp, 8, client->conn_fd) != 0) {
-            LOG_VERBOSE("%s:%d - [BID] Failed sending RBD NLG to client", client->ipv4, client->port);
-            if (errno == EPIPE)
-                LOG_VERBOSE("%s:%d - [BID] Connection closed by client", client->ipv4, client->port);
-        }
-        return 0;
-    }
-
-    // check if auction exists
-    if (!exists_auction(aid)) {
-        LOG_VERBOSE("%s:%d - [BID] Auction %s doesn't exist", client->ipv4, client->port, aid);
-        char *resp = "RBD ERR\n";
-        if (send_tcp_message(resp, 8, client->conn_fd) != 0) {
-            LOG_VERBOSE("%s:%d - [BID] Failed sending RBD ERR to client", client->ipv4, client->port);
-            if (errno == EPIPE)
-                LOG_VERBOSE("%s:%d - [BID] Connection closed by client", client->ipv4, client->port);
-        }
-        return 0;
-    }
+    char *resp = NULL;
+    switch (db_place_bid(aid, uid, passwd, bid_value)) {
+        case DB_OK:
+            break;
 
-    // read auction information 
-    char auction_info[256];
-    if (get_auction_info(aid, auction_info, 256) != 0) {
-        LOG_VERBOSE("%s:%d - [BID] Failed retrieving information about action %s", client->ipv4, client->port, aid);
-        char *resp = "RBD NOK\n";
-        if (send_tcp_message(resp, 8, client->conn_fd) != 0) {
-            LOG_VERBOSE("%s:%d - [BID] Failed sending RBD NOK to client", client->ipv4, client->port);
-            if (errno == EPIPE)
-                LOG_VERBOSE("%s:%d - [BID] Connection closed by client", client->ipv4, client->port);
-        }
-        return 0;
-    }
+        case DB_NO_USER:
+            LOG_VERBOSE("%s:%d - [BID] User %s doesn't exist", client->ipv4, client->port, uid);
+            resp = "RBD NOK\n";
+            break;
 
-    //"%s %s %s %d %d %s %ld\n", uid, name, fname, sv, ta, str_time, unix_start_time
-    char *owner_uid = strtok(auction_info, " ");
-    char *starting_value;
-    for (int i=0; i<2; i++) //skip name and fname
-        starting_value = strtok(NULL, " ");
-    starting_value = strtok(NULL, " ");
+        case DB_NOT_LOGGED_IN:
+            LOG_VERBOSE("%s:%d - [BID] User %s is not logged in or failed authentication", client->ipv4, client->port, uid);
+            resp = "RBD NLG\n";
+            break;
 
-    // check if user is the owner of desired auction
-    if (strcmp(owner_uid, uid) == 0) {
-        LOG_VERBOSE("%s:%d - [BID] Invalid owner for auction %s", client->ipv4, client->port, aid);
-        char *resp = "RBD ILG\n";
-        if (send_tcp_message(resp, 8, client->conn_fd) != 0) {
-            LOG_VERBOSE("%s:%d - [BID] Failed sending RBD ILG to client", client->ipv4, client->port);
-            if (errno == EPIPE)
-                LOG_VERBOSE("%s:%d - [BIDI] Connection closed by client", client->ipv4, client->port);
-        }
-        return 0;
-    }
+        case DB_NO_AUCTION:
+            LOG_VERBOSE("%s:%d - [BID] Auction %s doesn't exist", client->ipv4, client->port, aid);
+            resp = "RBD ERR\n";
+            break;
 
-    // check if auction is already finished
-    if (is_auction_finished(aid)) {
-        LOG_VERBOSE("%s:%d - [BID] Auction %s has already finished", client->ipv4, client->port, aid);
-        char *resp = "RBD NOK\n";
-        if (send_tcp_message(resp, 8, client->conn_fd) != 0) {
-            LOG_VERBOSE("%s:%d - [BID] Failed sending RBD NOK to client", client->ipv4, client->port);
-            if (errno == EPIPE)
-                LOG_VERBOSE("%s:%d - [BID] Connection closed by client", client->ipv4, client->port);
-        }
-        return 0;
-    }
+        case DB_OWN_AUCTION:
+            LOG_VERBOSE("%s:%d - [BID] Invalid owner for auction %s", client->ipv4, client->port, aid);
+            resp = "RBD ILG\n";
+            break;
 
-    if (!is_valid_start_value(starting_value)){
-        LOG_VERBOSE("%s:%d - [BID] Got a non numeric value from the starting value in file %s", client->ipv4, client->port, aid);
-        return BID_BAD_ARGS;
-    }
+        case DB_AUCTION_ENDED:
+            LOG_VERBOSE("%s:%d - [BID] Auction %s has already finished", client->ipv4, client->port, aid);
+            resp = "RBD NOK\n";
+            break;
 
-    int start_bid = atoi(starting_value);
-    int last_bid = get_last_bid(aid);
+        case DB_BID_REFUSED:
+            LOG_VERBOSE("%s:%d - [RBD] Bid value %d is too low", client->ipv4, client->port, bid_value);
+            resp = "RBD REF\n";
+            break;
 
-    if (last_bid < 0) {
-        LOG_VERBOSE("%s:%d - [BID] Failled getting last bid %s", client->ipv4, client->port, aid);
-        return BID_BAD_ARGS;
+        default:
+            LOG_VERBOSE("%s:%d - [BID] Failed placing bid on auction %s", client->ipv4, client->port, aid);
+            return BID_BAD_ARGS;
     }
 
-    if (last_bid == 0)
-        last_bid = start_bid;
-
-    //check if bid is acceptable
-    if (bid_value <= last_bid) {
-        LOG_VERBOSE("%s:%d - [RBD] Bid value %d is too low", client->ipv4, client->port, bid_value);
-        char *resp = "RBD REF\n";
+    if (resp != NULL) {
         if (send_tcp_message(resp, 8, client->conn_fd) != 0) {
-            LOG_VERBOSE("%s:%d - [BID] Failed sending RBD REF to client", client->ipv4, client->port);
+            LOG_VERBOSE("%s:%d - [BID] Failed sending %.7s to client", client->ipv4, client->port, resp);
             if (errno == EPIPE)
                 LOG_VERBOSE("%s:%d - [BID] Connection closed by client", client->ipv4, client->port);
         }
         return 0;
     }
 
-    if (bid(aid, uid, bid_value)){
-        LOG_VERBOSE("%s:%d - [RBD] Got a non numeric value from the starting value in file %s", client->ipv4, client->port, aid);
-        return BID_BAD_ARGS;
-    }
-
     LOG_VERBOSE("%s:%d - [BID] Successful bid %s", client->ipv4, client->port, aid);
-    char *resp = "RBD ACC\n";
+    resp = "RBD ACC\n";
     if (send_tcp_message(resp, 8, client->conn_fd) != 0) {
         LOG_VERBOSE("%s:%d - [BID] Failed sending RBD ACC to client", client->ipv4, client->port);
         if (errno == EPIPE)
@@ -845,6 +729,23 @@ int handle_bid(struct tcp_client *client) {
     return 0;
 }
 
+/**
+* Reads the rest of an AID whose first AID_SIZE digits were read, `aid_end` is the
+* byte read after them. Legacy AIDs end there with `delim`, extended AIDs have up
+* to EXT_AID_SIZE digits and the rest are read, up to `delim`, after `aid_end`.
+* Returns 0 on success and -1 if the AID isn't followed by `delim`
+*/
+int read_extended_aid(char *aid_end, char delim, int conn_fd) {
+    char *ptr = aid_end;
+    int extra = get_aid_size() - AID_SIZE;
+    while (*ptr != delim && ptr - aid_end < extra) {
+        if (!isdigit(*ptr) || recv(conn_fd, ++ptr, 1, 0) != 1)
+            return -1;
+    }
+
+    return *ptr == delim ? 0 : -1;
+}
+
 int is_valid_opa_arg(char *arg, int argno) {
     switch (argno) {
         case 0: return is_valid_name(arg);
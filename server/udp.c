@@ -1,5 +1,6 @@
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -14,15 +15,30 @@
 
 #include "udp.h"
 
+/**
+* Rendered LST response for a version of the auctions list. Every UDP thread
+* keeps its own, so responses can point to it while they wait to be sent, without
+* any lock. It isn't rendered again until those responses were sent
+*/
+struct list_cache {
+    char *payload;              // UDP_DATAGRAM_SIZE bytes, allocated on first use
+    size_t len;                 // 0 if nothing is cached
+    unsigned long version;      // version of the auctions list it was rendered from
+    int in_use;                 // a response waiting to be sent points to it
+};
+
+static __thread struct list_cache list_cache;
+
 /**
 * Hanle a UDP protocol command.
 * Returns 0 if command was sucessfully instructed by the program and -1 if the
 * command wasn't recognized.
 * 
-* If 0 is returned, the server response shall be written to response and the response_len
-* shall be set to indicate the response's size
+* If 0 is returned, the server response shall be written to *response and the response_len
+* shall be set to indicate the response's size. Handlers may instead point *response to
+* a cached response, which stays valid until release_udp_responses() is called
 */
-int handle_udp_command(char *request, struct udp_client *client, char *response, size_t *response_len) {
+int handle_udp_command(char *request, struct udp_client *client, char **response, size_t *response_len) {
     LOG_DEBUG("%s:%d - [UDP] Serving client", client->ipv4, client->port);
     // read the command
     char cmd[5] = {0};
@@ -41,8 +57,11 @@ int handle_udp_command(char *request, struct udp_client *client, char *response,
     if (err) {
         LOG_VERBOSE("%s:%d - [UDP] Badly formatted command", client->ipv4, client->port);
         char *error_msg = get_udp_error_msg(err);
-        sprintf(response, "%s", error_msg);
+        if (error_msg == NULL)
+            return -1;
+
         *response_len = strlen(error_msg);
+        memcpy(*response, error_msg, *response_len);
     }
 
     return 0;
@@ -54,14 +73,16 @@ int handle_udp_command(char *request, struct udp_client *client, char *response,
 * If an error occurs the corresponding error value is returned. If successful
 * 0 is returned
 **/
-int handle_login(char input[], struct udp_client *client, char *response, size_t *response_len) {
+int handle_login(char input[], struct udp_client *client, char **resp, size_t *response_len) {
+    char *response = *resp;
     LOG_DEBUG("%s:%d - [LIN] Entered handler", client->ipv4, client->port);
     /** 
     * Validate message parameters
     */
     char *uid, *passwd;
 
-    uid = strtok(input, " ");
+    char *save;
+    uid = strtok_r(input, " ", &save);
     if (uid == NULL) {
         LOG_VERBOSE("%s:%d - [LIN] No UID supplied", client->ipv4, client->port);
         return ERR_LIN;
@@ -74,7 +95,7 @@ int handle_login(char input[], struct udp_client *client, char *response, size_t
 
     // NOTE this makes the server permissive, that is, if we receive a LIN UID PASSWD\0
     // we also accepted, it's not the end of the world
-    passwd = strtok(NULL, "\n");
+    passwd = strtok_r(NULL, "\n", &save);
     if (passwd == NULL) {
         LOG_VERBOSE("%s:%d - [LIN] No password supplied", client->ipv4, client->port);
         return ERR_LIN;
@@ -118,14 +139,16 @@ int handle_login(char input[], struct udp_client *client, char *response, size_t
 }
 
 
-int handle_logout(char *input, struct udp_client *client, char *response, size_t *response_len) {
+int handle_logout(char *input, struct udp_client *client, char **resp, size_t *response_len) {
+    char *response = *resp;
     LOG_DEBUG("%s:%d - [LOU] Entered handler", client->ipv4, client->port);
     /** 
     * Validate message parameters
     */
     char *uid, *passwd;
 
-    uid = strtok(input, " ");
+    char *save;
+    uid = strtok_r(input, " ", &save);
     if (uid == NULL) {
         LOG_VERBOSE("%s:%d - [LOU] No UID supplied", client->ipv4, client->port);
         return ERR_LOU;
@@ -136,7 +159,7 @@ int handle_logout(char *input, struct udp_client *client, char *response, size_t
         return ERR_LOU;
     }
 
-    passwd = strtok(NULL, "\n");
+    passwd = strtok_r(NULL, "\n", &save);
     if (passwd == NULL) {
         LOG_VERBOSE("%s:%d - [LOU] No password supplied", client->ipv4, client->port);
         return ERR_LOU;
@@ -185,14 +208,16 @@ int handle_logout(char *input, struct udp_client *client, char *response, size_t
 }
 
 
-int handle_unregister(char *input, struct udp_client *client, char *response, size_t *response_len) {
+int handle_unregister(char *input, struct udp_client *client, char **resp, size_t *response_len) {
+    char *response = *resp;
     LOG_DEBUG("%s:%d - [UNR] Entered handler", client->ipv4, client->port);
 
     /** 
     * Validate message parameters
     */
     char *uid, *passwd;
-    uid = strtok(input, " ");
+    char *save;
+    uid = strtok_r(input, " ", &save);
     if (uid == NULL) {
         LOG_VERBOSE("%s:%d - [UNR] No UID supplied", client->ipv4, client->port);
         return ERR_UNR;
@@ -203,7 +228,7 @@ int handle_unregister(char *input, struct udp_client *client, char *response, si
         return ERR_UNR;
     }
 
-    passwd = strtok(NULL, "\n");
+    passwd = strtok_r(NULL, "\n", &save);
     if (passwd == NULL) {
         LOG_VERBOSE("%s:%d - [UNR] No password supplied", client->ipv4, client->port);
         return ERR_UNR;
@@ -252,12 +277,14 @@ int handle_unregister(char *input, struct udp_client *client, char *response, si
 }
 
 
-int handle_my_auctions(char *input, struct udp_client *client, char *response, size_t *response_len) {
+int handle_my_auctions(char *input, struct udp_client *client, char **resp, size_t *response_len) {
+    char *response = *resp;
     LOG_DEBUG("%s:%d - [LMA] Entered handler", client->ipv4, client->port);
     /**
     * validate command arguments 
     */
-    char *uid = strtok(input, "\n");
+    char *save;
+    char *uid = strtok_r(input, "\n", &save);
     if (uid == NULL) {
         LOG_VERBOSE("%s:%d - [LMA] No UID supplied", client->ipv4, client->port);
         return ERR_LMA;
@@ -285,17 +312,14 @@ int handle_my_auctions(char *input, struct udp_client *client, char *response, s
         return 0;
     }
 
-    // update database
-    update_database();
-
     /**
     * Start creating my auctions response
     */
-    sprintf(response, "RMA OK");
+    memcpy(response, "RMA OK", 6);
     *response_len = 6;
     // write response
 
-    int written = get_user_auctions(uid, response);
+    int written = get_user_auctions(uid, response + 6, UDP_DATAGRAM_SIZE - 6);
     // error reading user auctions
     if (written < 0) {
         LOG_VERBOSE("%s:%d - [LMA] Internal error processing user %s auctions", client->ipv4, client->port, uid);
@@ -320,10 +344,12 @@ int handle_my_auctions(char *input, struct udp_client *client, char *response, s
 /**
  * Lists all the bids done by a user
 */
-int handle_my_bids(char *input, struct udp_client *client, char *response, size_t *response_len) {
+int handle_my_bids(char *input, struct udp_client *client, char **resp, size_t *response_len) {
+    char *response = *resp;
     LOG_DEBUG("entered handle_my_bids");
 
-    char *uid = strtok(input, "\n");
+    char *save;
+    char *uid = strtok_r(input, "\n", &save);
     if (uid == NULL) {
         LOG_VERBOSE("%s:%d - [LMB] No UID supplied", client->ipv4, client->port);
         return ERR_MB;
@@ -352,16 +378,13 @@ int handle_my_bids(char *input, struct udp_client *client, char *response, size_
         return 0;
     }
 
-    // update database
-    update_database();
-
     /**
     * Start creating my bids response
     */
-    sprintf(response, "RMB OK");
+    memcpy(response, "RMB OK", 6);
     *response_len = 6;
 
-    int written = get_user_bids(uid, response);
+    int written = get_user_bids(uid, response + 6, UDP_DATAGRAM_SIZE - 6);
     if (written < 0) {
         LOG_VERBOSE("%s:%d - [LMB] Internal error processing user %s bids", client->ipv4, client->port, uid);
         return ERR_MB;
@@ -381,18 +404,42 @@ int handle_my_bids(char *input, struct udp_client *client, char *response, size_
 }
 
 
-int handle_list(char *input, struct udp_client *client, char *response, size_t *response_len) {
+/**
+* Lists every auction. The response is the same for everyone until an auction
+* opens or ends, so it's sent straight from the thread's cache while the version
+* of the auctions list doesn't change
+*/
+int handle_list(char *input, struct udp_client *client, char **resp, size_t *response_len) {
     LOG_DEBUG("%s:%d - [LST] Entered handler", client->ipv4, client->port);
-    // update database
-    update_database();
+
+    // read before rendering, so a change made meanwhile makes the cache stale
+    unsigned long version = get_db_version();
+    if (list_cache.len > 0 && list_cache.version == version) {
+        LOG_VERBOSE("%s:%d - [LST] Sent cached auction list to client", client->ipv4, client->port);
+        list_cache.in_use = 1;
+        *resp = list_cache.payload;
+        *response_len = list_cache.len;
+        return 0;
+    }
+
+    // render into the cache, unless responses waiting to be sent point to it
+    if (!list_cache.in_use && list_cache.payload == NULL)
+        list_cache.payload = malloc(UDP_DATAGRAM_SIZE);
+
+    char *response = *resp;
+    if (!list_cache.in_use && list_cache.payload != NULL) {
+        response = list_cache.payload;
+        list_cache.len = 0;
+    }
+
     /**
     * Build and send response
     */
-    sprintf(response, "RLS OK");
+    memcpy(response, "RLS OK", 6);
     *response_len = 6;
 
     // get auctions list
-    int written = get_auctions_list(response);
+    int written = get_auctions_list(response + 6, UDP_DATAGRAM_SIZE - 6);
     if (written < 0) {
         LOG_VERBOSE("%s:%d - [LST] Internal error processing auctions list", client->ipv4, client->port);
         return ERR_LST;
@@ -402,30 +449,45 @@ int handle_list(char *input, struct udp_client *client, char *response, size_t *
         LOG_VERBOSE("%s:%d - [LST] No aucions in server", client->ipv4, client->port);
         sprintf(response, "RLS NOK\n");
         *response_len = 8;
-        return 0;
+    } else {
+        LOG_VERBOSE("%s:%d - [LST] Sent auction list to client", client->ipv4, client->port);
+        *response_len += written;
     }
 
+    if (response == list_cache.payload) {
+        list_cache.len = *response_len;
+        list_cache.version = version;
+        list_cache.in_use = 1;
+        *resp = response;
+    }
 
-    LOG_VERBOSE("%s:%d - [LST] Sent auction list to client", client->ipv4, client->port);
-
-    *response_len += written;
     return 0;
 }
 
+/**
+* Called once the responses of the thread were sent, the cached responses they
+* pointed to may be rendered again
+*/
+void release_udp_responses() {
+    list_cache.in_use = 0;
+}
+
 
-int handle_show_record(char *input, struct udp_client *client, char *response, size_t *response_len) {
+int handle_show_record(char *input, struct udp_client *client, char **resp, size_t *response_len) {
+    char *response = *resp;
     LOG_DEBUG("%s:%d - [SRC] Entered handler", client->ipv4, client->port);
     /**
     * Validate command arguments 
     */
     char *aid;
-    aid = strtok(input, "\n");
+    char *save;
+    aid = strtok_r(input, "\n", &save);
     if (aid == NULL) {
         LOG_VERBOSE("%s:%d - [SRC] No UID supplied", client->ipv4, client->port);
         return ERR_SRC; 
     }
 
-    if (!is_valid_aid(aid)) {
+    if (!is_valid_extended_aid(aid, get_aid_size())) {
         LOG_VERBOSE("%s:%d - [SRC] Invalid UID", client->ipv4, client->port);
         return ERR_SRC;
     }
@@ -437,8 +499,14 @@ int handle_show_record(char *input, struct udp_client *client, char *response, s
         return 0;
     }
 
-    // update database
-    update_database();
+    // the record only changes with a bid or when the auction ends
+    unsigned long version = 0;
+    int cached = get_cached_auction_record(aid, response, UDP_DATAGRAM_SIZE, &version);
+    if (cached > 0) {
+        LOG_VERBOSE("%s:%d - [SRC] Sent cached auction %s record to client", client->ipv4, client->port, aid);
+        *response_len = cached;
+        return 0;
+    }
 
     /**
     * Create show record response
@@ -450,7 +518,7 @@ int handle_show_record(char *input, struct udp_client *client, char *response, s
     }
 
     // validate database values (these shouldn't be wrong, but if they are db is corrupted)
-    char *host_uid = strtok(auction_info, " ");
+    char *host_uid = strtok_r(auction_info, " ", &save);
     if (host_uid == NULL) {
         LOG_DEBUG("No host UID");
         return ERR_SRC;
@@ -461,7 +529,7 @@ int handle_show_record(char *input, struct udp_client *client, char *response, s
         return ERR_SRC;
     }
 
-    char *asset_name = strtok(NULL, " ");
+    char *asset_name = strtok_r(NULL, " ", &save);
     if (asset_name == NULL) {
         LOG_DEBUG("No asset name");
         return ERR_SRC;
@@ -472,7 +540,7 @@ int handle_show_record(char *input, struct udp_client *client, char *response, s
         return ERR_SRC;
     }
     
-    char *fname = strtok(NULL, " ");
+    char *fname = strtok_r(NULL, " ", &save);
     if (fname == NULL) {
         LOG_DEBUG("No asset fname");
         return ERR_SRC;
@@ -483,7 +551,7 @@ int handle_show_record(char *input, struct udp_client *client, char *response, s
         return ERR_SRC;
     }
 
-    char *sv = strtok(NULL, " ");
+    char *sv = strtok_r(NULL, " ", &save);
     if (sv == NULL) {
         LOG_DEBUG("No start value");
         return ERR_SRC;
@@ -494,7 +562,7 @@ int handle_show_record(char *input, struct udp_client *client, char *response, s
         return ERR_SRC;
     }
 
-    char *ta = strtok(NULL, " ");
+    char *ta = strtok_r(NULL, " ", &save);
     if (ta == NULL) {
         LOG_DEBUG("No time active");
         return ERR_SRC;
@@ -505,13 +573,13 @@ int handle_show_record(char *input, struct udp_client *client, char *response, s
         return ERR_SRC;
     }
 
-    char *start_date = strtok(NULL, " ");
+    char *start_date = strtok_r(NULL, " ", &save);
     if (start_date == NULL) {
         LOG_DEBUG("No start date");
         return ERR_SRC;
     }
 
-    char *start_time = strtok(NULL, " ");
+    char *start_time = strtok_r(NULL, " ", &save);
     if (start_time == NULL) {
         LOG_DEBUG("No start time")
         return ERR_SRC;
@@ -522,28 +590,24 @@ int handle_show_record(char *input, struct udp_client *client, char *response, s
         return ERR_SRC;
     }
 
-    char *start_sec_time = strtok(NULL, "\n");
+    char *start_sec_time = strtok_r(NULL, "\n", &save);
     if (start_sec_time == NULL) {
         LOG_DEBUG("No start sec time");
         return ERR_SRC;
     }
 
-    sprintf(response, "RRC OK %s %s %s %s %s %s %s", 
+    int len = snprintf(response, UDP_DATAGRAM_SIZE, "RRC OK %s %s %s %s %s %s %s", 
                                         host_uid, asset_name, fname,
                                         sv, start_date, start_time, ta);
 
-    *response_len = strlen(response);
-
-    int written = get_auction_bidders_list(aid, response);
+    int written = get_auction_bidders_list(aid, response + len, UDP_DATAGRAM_SIZE - len);
     if (written < 0) {
         LOG_VERBOSE("%s:%d - [SRC] Internal error processing auction %s bids", client->ipv4, client->port, aid);
         return ERR_SRC;
     }
 
-    *response_len += written;
-
-    strcat(response, "\n");
-    written += 1;
+    *response_len = len + written;
+    cache_auction_record(aid, version, response, *response_len);
 
     LOG_VERBOSE("%s:%d - [LST] Sent auction %s record to client", client->ipv4, client->port, aid);
 
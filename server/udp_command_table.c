@@ -37,6 +37,7 @@ char *udp_errors_table[] = {
     "RMA ERR\n", 
     "RMB ERR\n", 
     "RRC ERR\n", 
+    "RLS ERR\n", 
 };
 
 static
@@ -61,7 +62,7 @@ udp_handler_fn get_udp_handler_fn(char *cmd) {
 }
 
 char *get_udp_error_msg(int errcode) {
-    if (errcode < 0 || errcode >= udp_error_table_entries)
+    if (errcode < 1 || errcode > udp_error_table_entries)
         return NULL;
 
     return udp_errors_table[errcode - 1];
@@ -12,7 +12,7 @@
 #define ERR_SRC 6
 #define ERR_LST 7
 
-typedef int (*udp_handler_fn)(char *req, struct udp_client *client, char *resp, size_t *resp_len);
+typedef int (*udp_handler_fn)(char *req, struct udp_client *client, char **resp, size_t *resp_len);
 udp_handler_fn get_udp_handler_fn(char *cmd);
 char *get_udp_error_msg(int errcode);
 
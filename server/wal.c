@@ -0,0 +1,295 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "../utils/config.h"
+#include "../utils/logging.h"
+
+#include "wal.h"
+
+static const mode_t WAL_MODE = S_IREAD | S_IWRITE;
+
+static int wal_fd = -1;
+static unsigned long last_lsn = 0;  // LSN of the last record in the log
+static off_t wal_size = 0;          // size of the valid part of the log
+static pthread_mutex_t wal_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+* Group commit. Committers wait in wal_sync() for the sync thread, which syncs
+* every record appended so far with a single fdatasync() and wakes them all up.
+*
+* Records are applied to the database before they are synced, so other clients
+* can see a change before it is durable and before its own client is answered.
+* A failed sync can't be rolled back once others saw the change, so it is fatal:
+* on restart only the records that reached the disk are replayed
+*/
+static wal_durability_t durability = WAL_DURABILITY_NONE;
+static unsigned long requested_lsn = 0; // last record a committer waits for
+static unsigned long synced_lsn = 0;    // last record known to be in disk
+static pthread_mutex_t sync_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sync_cond = PTHREAD_COND_INITIALIZER;     // records are waiting to be synced
+static pthread_cond_t synced_cond = PTHREAD_COND_INITIALIZER;   // a batch was synced
+
+unsigned int wal_checksum(struct wal_record *rec);
+void *wal_sync_thread(void *arg);
+
+/**
+* Sets how records are synced, must be called before wal_open()
+*/
+void wal_set_durability(wal_durability_t level) {
+    durability = level;
+}
+
+/**
+* Opens the log in `path`, creating it if it doesn't exist, and replays its
+* records after `from_lsn` in order by calling `apply` on each one. Records up to
+* `from_lsn` are already part of a snapshot and are skipped. Records that fail to
+* apply are logged and skipped. A torn or corrupted record ends the replay and it
+* is discarded with everything after it, so new records are appended right after
+* the last valid one. Returns 0 on success and -1 on failure.
+*/
+int wal_open(char *path, unsigned long from_lsn, int (*apply)(struct wal_record *rec)) {
+    if ((wal_fd = open(path, O_CREAT | O_RDWR | O_APPEND, WAL_MODE)) < 0) {
+        LOG_ERROR("[WAL] Failed opening log file %s", path);
+        LOG_ERROR("[WAL] open: %s", strerror(errno));
+        return -1;
+    }
+
+    static struct wal_record batch[WAL_REPLAY_BATCH];
+    unsigned long prev_lsn = 0;     // LSN of the previous record in the log
+    unsigned long n_replayed = 0;
+    int done = 0;
+    while (!done) {
+        ssize_t n = read(wal_fd, batch, sizeof(batch));
+        if (n < 0) {
+            LOG_ERROR("[WAL] Failed reading log file %s", path);
+            LOG_ERROR("[WAL] read: %s", strerror(errno));
+            return -1;
+        }
+
+        // a short read only happens at the end of the log
+        done = n < (ssize_t)sizeof(batch);
+
+        int n_records = n / sizeof(struct wal_record);
+        for (int i = 0; i < n_records; ++i) {
+            struct wal_record *rec = &batch[i];
+            if (rec->checksum != wal_checksum(rec)) {
+                done = 1;
+                break;
+            }
+
+            // the log either continues the snapshot or wasn't truncated after it
+            if (prev_lsn == 0 ? rec->lsn > from_lsn + 1 : rec->lsn != prev_lsn + 1) {
+                LOG_ERROR("[WAL] Found record %lu after record %lu, expected a record up to %lu",
+                            rec->lsn, prev_lsn, (prev_lsn == 0 ? from_lsn : prev_lsn) + 1);
+                done = 1;
+                break;
+            }
+
+            prev_lsn = rec->lsn;
+            wal_size += sizeof(struct wal_record);
+            if (rec->lsn <= from_lsn)
+                continue;
+
+            if (apply(rec) != 0)
+                LOG_DEBUG("[WAL] Failed applying record %lu of type %d", rec->lsn, rec->type);
+
+            n_replayed++;
+        }
+    }
+
+    off_t file_size = lseek(wal_fd, 0, SEEK_END);
+    if (file_size > wal_size) {
+        LOG_WARN("[WAL] Discarding %ld bytes of torn records at the end of the log", (long)(file_size - wal_size));
+        if (ftruncate(wal_fd, wal_size) != 0) {
+            LOG_ERROR("[WAL] ftruncate: %s", strerror(errno));
+            return -1;
+        }
+    }
+
+    last_lsn = prev_lsn > from_lsn ? prev_lsn : from_lsn;
+    synced_lsn = requested_lsn = last_lsn;
+    LOG_VERBOSE("[WAL] Replayed %lu records", n_replayed);
+
+    pthread_t sync_tid;
+    if (durability == WAL_DURABILITY_GROUP) {
+        if (pthread_create(&sync_tid, NULL, wal_sync_thread, NULL) != 0 || pthread_detach(sync_tid) != 0) {
+            LOG_ERROR("[WAL] Failed starting the sync thread");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+* Appends a record to the log, assigning it the next LSN. Records must be zeroed
+* before they are filled so their padding doesn't change the checksum.
+* Returns 0 on success and -1 if the record couldn't be written. With strict
+* durability the server exits if it couldn't be synced
+*/
+int wal_append(struct wal_record *rec) {
+    pthread_mutex_lock(&wal_mutex);
+
+    rec->lsn = last_lsn + 1;
+    rec->checksum = wal_checksum(rec);
+
+    ssize_t n = write(wal_fd, rec, sizeof(struct wal_record));
+    if (n != sizeof(struct wal_record)) {
+        LOG_ERROR("[WAL] Failed appending record %lu to the log", rec->lsn);
+        if (n < 0)
+            LOG_ERROR("[WAL] write: %s", strerror(errno));
+
+        if (n > 0 && ftruncate(wal_fd, wal_size) != 0) { // drop the partial record
+            LOG_ERROR("[WAL] ftruncate: %s", strerror(errno));
+        }
+
+        pthread_mutex_unlock(&wal_mutex);
+        return -1;
+    }
+
+    // as with group commits, once a sync fails the kernel may have dropped the
+    // pages it couldn't write, so the records left in the log can't be trusted
+    if (durability == WAL_DURABILITY_STRICT && fdatasync(wal_fd) != 0) {
+        LOG_ERROR("[WAL] Failed syncing record %lu", rec->lsn);
+        LOG_ERROR("[WAL] fdatasync: %s, fatal...", strerror(errno));
+        exit(1);
+    }
+
+    last_lsn = rec->lsn;
+    wal_size += sizeof(struct wal_record);
+
+    pthread_mutex_unlock(&wal_mutex);
+    return 0;
+}
+
+/**
+* Waits until an appended record is in disk. Records are synced in the order they
+* were appended, so every record before it is also in disk. Returns 0, the server
+* exits if the record couldn't be synced
+*/
+int wal_sync(struct wal_record *rec) {
+    if (durability != WAL_DURABILITY_GROUP)
+        return 0;
+
+    pthread_mutex_lock(&sync_mutex);
+
+    if (rec->lsn > requested_lsn) {
+        requested_lsn = rec->lsn;
+        pthread_cond_signal(&sync_cond);
+    }
+
+    while (synced_lsn < rec->lsn)
+        pthread_cond_wait(&synced_cond, &sync_mutex);
+
+    pthread_mutex_unlock(&sync_mutex);
+    return 0;
+}
+
+/**
+* Syncs the log whenever committers are waiting. Once the first one arrives, it
+* gives others WAL_GROUP_COMMIT_USEC to join the batch, unless
+* WAL_GROUP_COMMIT_RECORDS records are already waiting
+*/
+void *wal_sync_thread(void *arg) {
+    pthread_mutex_lock(&sync_mutex);
+    while (1) {
+        while (requested_lsn <= synced_lsn)
+            pthread_cond_wait(&sync_cond, &sync_mutex);
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += WAL_GROUP_COMMIT_USEC * 1000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        while (requested_lsn - synced_lsn < WAL_GROUP_COMMIT_RECORDS) {
+            if (pthread_cond_timedwait(&sync_cond, &sync_mutex, &deadline) != 0)
+                break;
+        }
+
+        pthread_mutex_unlock(&sync_mutex);
+
+        // every record appended until now is in the batch, not only the requested ones
+        unsigned long lsn = wal_last_lsn();
+        if (fdatasync(wal_fd) != 0) {
+            LOG_ERROR("[WAL] Failed syncing the log up to record %lu", lsn);
+            LOG_ERROR("[WAL] fdatasync: %s, fatal...", strerror(errno));
+            exit(1);
+        }
+
+        pthread_mutex_lock(&sync_mutex);
+        synced_lsn = lsn;
+        pthread_cond_broadcast(&synced_cond);
+    }
+
+    return NULL;
+}
+
+/**
+* Discards all records in the log, once they are part of a snapshot. LSNs keep
+* growing from the last discarded record. Returns 0 on success and -1 on failure
+*/
+int wal_truncate() {
+    pthread_mutex_lock(&wal_mutex);
+
+    if (ftruncate(wal_fd, 0) != 0) {
+        LOG_ERROR("[WAL] Failed truncating the log");
+        LOG_ERROR("[WAL] ftruncate: %s", strerror(errno));
+        pthread_mutex_unlock(&wal_mutex);
+        return -1;
+    }
+
+    wal_size = 0;
+
+    pthread_mutex_unlock(&wal_mutex);
+    return 0;
+}
+
+unsigned long wal_last_lsn() {
+    pthread_mutex_lock(&wal_mutex);
+    unsigned long lsn = last_lsn;
+    pthread_mutex_unlock(&wal_mutex);
+    return lsn;
+}
+
+void wal_close() {
+    if (wal_fd >= 0 && close(wal_fd) != 0) {
+        LOG_DEBUG("[WAL] Failed closing log file descriptor");
+        LOG_DEBUG("[WAL] close: %s", strerror(errno));
+    }
+
+    wal_fd = -1;
+}
+
+/**
+* Checksum of the record, computed as if its checksum field was 0
+*/
+unsigned int wal_checksum(struct wal_record *rec) {
+    unsigned int stored = rec->checksum;
+    rec->checksum = 0;
+
+    unsigned int hash = wal_hash(rec, sizeof(struct wal_record), WAL_HASH_SEED);
+
+    rec->checksum = stored;
+    return hash;
+}
+
+/**
+* FNV-1a hash of `n` bytes of data. Data can be hashed in parts by passing the
+* hash of the previous part, the first part is hashed with WAL_HASH_SEED
+*/
+unsigned int wal_hash(const void *data, size_t n, unsigned int hash) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < n; ++i) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
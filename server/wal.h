@@ -0,0 +1,65 @@
+#ifndef __WAL_H__
+#define __WAL_H__
+
+#include <stddef.h>
+
+#include "../utils/constants.h"
+
+/**
+* Write-ahead log. Every state change of the database is appended to a single
+* log file as a fixed size record. The database state is rebuilt by replaying
+* the records in order when the server starts.
+*/
+typedef enum {
+    WAL_REGISTER = 1,
+    WAL_UNREGISTER,
+    WAL_LOGIN,
+    WAL_LOGOUT,
+    WAL_OPEN,
+    WAL_BID,
+    WAL_CLOSE,
+    WAL_EXPIRE,
+} wal_record_t;
+
+struct wal_record {
+    unsigned long lsn;                  // log sequence number, starts at 1
+    unsigned int checksum;              // checksum of the record with this field set to 0
+    int type;                           // wal_record_t
+    int aid;
+    int value;                          // bid value or auction start value
+    int time_active;
+    long time;                          // UNIX timestamp of the operation
+    char uid[UID_SIZE + 1];
+    char passwd[PASSWORD_SIZE + 1];
+    char name[ASSET_NAME_LEN + 1];
+    char fname[FNAME_LEN + 1];
+};
+
+/**
+* How appended records reach the disk before wal_sync() returns:
+*
+* WAL_DURABILITY_NONE   - never synced, left to the page cache
+* WAL_DURABILITY_GROUP  - a sync thread syncs the records of concurrent commits
+*                         together, every WAL_GROUP_COMMIT_USEC or once
+*                         WAL_GROUP_COMMIT_RECORDS records are waiting
+* WAL_DURABILITY_STRICT - every record is synced as it is appended
+*/
+typedef enum {
+    WAL_DURABILITY_NONE,
+    WAL_DURABILITY_GROUP,
+    WAL_DURABILITY_STRICT,
+} wal_durability_t;
+
+void wal_set_durability(wal_durability_t level);
+int wal_open(char *path, unsigned long from_lsn, int (*apply)(struct wal_record *rec));
+int wal_append(struct wal_record *rec);
+int wal_sync(struct wal_record *rec);
+int wal_truncate();
+unsigned long wal_last_lsn();
+void wal_close();
+
+unsigned int wal_hash(const void *data, size_t n, unsigned int hash);
+
+#define WAL_HASH_SEED 2166136261u
+
+#endif
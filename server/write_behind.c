@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "../utils/config.h"
+#include "../utils/constants.h"
+#include "../utils/logging.h"
+
+#include "write_behind.h"
+
+/**
+* Ring of queued records. Records are numbered in the order they are pushed, the
+* record numbered `n` is in queue[n % WRITE_BEHIND_QUEUE_SZ]
+*/
+static struct wal_record queue[WRITE_BEHIND_QUEUE_SZ];
+static unsigned long pushed = 0;        // records pushed
+static unsigned long taken = 0;         // records taken by the writer
+static unsigned long written = 0;       // records taken and written
+static unsigned long coalesced = 0;     // records merged into a queued one
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t not_empty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t not_full = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t drained = PTHREAD_COND_INITIALIZER;
+
+#define CANCELLED_RECORD 0 // type of a queued login and a logout that cancel each other
+
+/**
+* 1 + the number of the last login or logout record queued for each user, 0 if
+* there is none. It can be coalesced until the writer takes it
+*/
+static unsigned long login_records[MAX_USERS];
+
+static int (*write_record)(struct wal_record *rec);
+
+void *write_behind_thread(void *arg);
+
+/**
+* Starts the writer thread, which writes every queued record with `write`.
+* Returns 0 on success and -1 on failure
+*/
+int write_behind_start(int (*write)(struct wal_record *rec)) {
+    write_record = write;
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, write_behind_thread, NULL) != 0 || pthread_detach(tid) != 0) {
+        LOG_ERROR("[DB] Failed starting the write-behind thread");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+* Queues a record to be written. A login or logout of a user whose previous
+* login or logout is still queued undoes it, so both are dropped, or takes the
+* place of a dropped one, since only the last one shows in the directory layout.
+* Blocks while the queue is full. Returns 0 on success
+*/
+int write_behind_push(struct wal_record *rec) {
+    int uid = atoi(rec->uid) % MAX_USERS;
+    int login = rec->type == WAL_LOGIN || rec->type == WAL_LOGOUT;
+
+    pthread_mutex_lock(&queue_mutex);
+
+    if (login && login_records[uid] > taken) {
+        struct wal_record *queued = &queue[(login_records[uid] - 1) % WRITE_BEHIND_QUEUE_SZ];
+        queued->type = queued->type == CANCELLED_RECORD ? rec->type : CANCELLED_RECORD;
+        coalesced++;
+        pthread_mutex_unlock(&queue_mutex);
+        return 0;
+    }
+
+    while (pushed - taken == WRITE_BEHIND_QUEUE_SZ)
+        pthread_cond_wait(&not_full, &queue_mutex);
+
+    queue[pushed % WRITE_BEHIND_QUEUE_SZ] = *rec;
+    pushed++;
+
+    // registering and unregistering also change the login, so they end coalescing
+    if (login)
+        login_records[uid] = pushed;
+    else if (rec->type == WAL_REGISTER || rec->type == WAL_UNREGISTER)
+        login_records[uid] = 0;
+
+    pthread_cond_signal(&not_empty);
+    pthread_mutex_unlock(&queue_mutex);
+    return 0;
+}
+
+/**
+* Waits until every queued record is written
+*/
+void write_behind_flush() {
+    pthread_mutex_lock(&queue_mutex);
+
+    while (written != pushed)
+        pthread_cond_wait(&drained, &queue_mutex);
+
+    pthread_mutex_unlock(&queue_mutex);
+}
+
+void write_behind_stats() {
+    pthread_mutex_lock(&queue_mutex);
+    LOG("[DB] write-behind: %lu queued, %lu written, %lu coalesced", pushed - written, written, coalesced);
+    pthread_mutex_unlock(&queue_mutex);
+}
+
+/**
+* Writes the queued records in the order they were pushed
+*/
+void *write_behind_thread(void *arg) {
+    pthread_mutex_lock(&queue_mutex);
+    while (1) {
+        while (taken == pushed)
+            pthread_cond_wait(&not_empty, &queue_mutex);
+
+        struct wal_record rec = queue[taken % WRITE_BEHIND_QUEUE_SZ];
+        taken++;
+        pthread_cond_signal(&not_full);
+
+        pthread_mutex_unlock(&queue_mutex);
+
+        if (rec.type != CANCELLED_RECORD && write_record(&rec) != 0) {
+            LOG_ERROR("[DB] Failed writing record of type %d, database might be corrupted", rec.type);
+        }
+
+        pthread_mutex_lock(&queue_mutex);
+        written++;
+        if (written == pushed)
+            pthread_cond_broadcast(&drained);
+    }
+
+    return NULL;
+}
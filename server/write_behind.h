@@ -0,0 +1,17 @@
+#ifndef __WRITE_BEHIND_H__
+#define __WRITE_BEHIND_H__
+
+#include "wal.h"
+
+/**
+* Write-behind queue of the FS engine. Committed records are queued in memory and
+* a writer thread writes them to the directory layout in order, so requests
+* don't wait for the disk. A login and a logout of a user that are both still
+* queued cancel each other.
+*/
+int write_behind_start(int (*write)(struct wal_record *rec));
+int write_behind_push(struct wal_record *rec);
+void write_behind_flush();
+void write_behind_stats();
+
+#endif
@@ -7,8 +7,25 @@
 * Server configurations
 */
 #define DB_ROOT "ASDIR" // database root directory name
+#define DB_LOG_FILE "DB.log" // write-ahead log of the log storage engine, inside DB_ROOT
+#define WAL_REPLAY_BATCH 256 // number of log records read at once when replaying the log
+#define DB_SNAPSHOT_FILE "DB.snap" // latest snapshot of the log storage engine, inside DB_ROOT
+#define DB_SNAPSHOT_INTERVAL 100000 // log records written between snapshots
+#define DB_MEM_ROOT "ASDIR.mem.XXXXXX" // private directory of the memory engine assets, removed on exit
+#define DB_STAGING_DIR "STAGING" // assets being uploaded, inside DB_ROOT
+#define DB_AUCTION_TABLE_FILE "auctions.tbl" // fixed-size auction records of the FS engine, inside DB_ROOT
+#define WAL_GROUP_COMMIT_USEC 500 // longest a group commit waits for other records to join it
+#define WAL_GROUP_COMMIT_RECORDS 32 // records waiting that make a group commit sync right away
+#define WRITE_BEHIND_QUEUE_SZ 65536 // records the FS engine queues before requests wait for its writer
+#define FS_DIR_CACHE_SZ 256 // user and auction directories kept open by the FS engine
+#define SRC_CACHE_MAX_BYTES (64 << 20) // bytes of SRC responses cached for all the auctions together
 
 #define THREAD_POOL_SZ 30 // number of TCP worker threads (also max number of TCP connections allowed)
+#define UDP_THREADS 4 // number of UDP server threads, each one with its own socket bound to the port
+#define UDP_BATCH 16 // most UDP requests received and answered with a single system call
+
+#define DB_LOCK_STRIPES 64 // number of mutexes users and auctions are hashed into
+#define DB_LOAD_THREADS 8 // threads loading the FS engine database on startup
 
 #define TCP_SERV_TIMEOUT 5 // in seconds
 #define UDP_SERV_TIMEOUT 5  // in seconds
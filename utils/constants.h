@@ -4,12 +4,18 @@
 #define UID_SIZE 6
 #define PASSWORD_SIZE 8
 #define AID_SIZE 3
+#define EXT_AID_SIZE 6 // AID digits in extended AID mode
+#define MAX_USERS 1000000 // number of distinct UIDs
+#define MAX_AUCTIONS 999 // largest AID that fits in AID_SIZE digits
+#define MAX_EXT_AUCTIONS 999999 // largest AID that fits in EXT_AID_SIZE digits
 
 #define ASSET_NAME_LEN 10
 #define START_VALUE_LEN 6 
 #define TIME_ACTIVE_LEN 5
 
 #define MAX_BID_VALUE 6
+#define MAX_SHOWN_BIDS 50 // bids of an auction shown by SRC, the biggest ones
+#define MAX_LISTED_AUCTIONS 7000 // auctions shown by LST, LMA and LMB, the last ones, so they fit in a datagram
 
 #define FNAME_LEN 24
 #define FSIZE_STR_LEN 8
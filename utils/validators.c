@@ -176,6 +176,25 @@ int is_valid_aid(char *aid) {
     return 1;
 }
 
+/**
+* Check if aid is a legacy AID of AID_SIZE digits or an extended AID of up to
+* max_size digits. Extended AIDs are written without leading zeros
+*/
+int is_valid_extended_aid(char *aid, int max_size) {
+    size_t len = strlen(aid);
+
+    if (len == AID_SIZE)
+        return is_valid_aid(aid);
+
+    if (len < AID_SIZE || len > max_size || aid[0] == '0')
+        return 0;
+
+    for (int i = 0; i < len; i++)
+        if (!isdigit(aid[i])) return 0;
+
+    return 1;
+}
+
 
 /**
 * Check if given date and time strings match the format YYYY-MM-DD HH:MM:SS
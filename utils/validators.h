@@ -7,6 +7,7 @@ int is_valid_ip_addr(char *);
 int is_valid_uid(char *);
 int is_valid_passwd(char *);
 int is_valid_aid(char *);
+int is_valid_extended_aid(char *aid, int max_size);
 
 int is_valid_name(char *);
 int is_valid_start_value(char *);